@@ -0,0 +1,116 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "CommandParser.h"
+
+using namespace std;
+
+/**
+ * 指令解析微基準測試
+ *
+ * 比較舊版 stringstream + transform + if/else 與
+ * CommandTokenizer + lookupVerb 的每則指令解析時間。
+ * 用法: ./bench_parser [iterations]
+ */
+
+static const vector<string> SAMPLE_COMMANDS = {
+    "ROOM_MSG general hello everyone, how is it going?",
+    "LIST",
+    "LOGIN alice secret123 9001",
+    "ROOM_HISTORY general",
+    "GET_USER_INFO bob",
+    "JOIN_ROOM general",
+    "list_rooms",
+    "MESSAGE just a plain message",
+    "ENCRYPTION_STATUS",
+    "ROOM_MEMBERS general",
+    "UNKNOWN_VERB something",
+};
+
+// 舊版解析：每個 token 都是新的 std::string
+static size_t legacyParse(const string& command) {
+    stringstream ss(command);
+    string cmd;
+    ss >> cmd;
+    transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+
+    string a, b, rest;
+    int port = 0;
+    if (cmd == "REGISTER") { ss >> a >> b; return 1 + a.size() + b.size(); }
+    else if (cmd == "LOGIN") { ss >> a >> b >> port; return 2 + a.size() + b.size() + port; }
+    else if (cmd == "LOGOUT") return 3;
+    else if (cmd == "LIST") return 4;
+    else if (cmd == "MESSAGE") { getline(ss, rest); return 5 + rest.size(); }
+    else if (cmd == "GET_USER_INFO") { ss >> a; return 6 + a.size(); }
+    else if (cmd == "ENCRYPTION_STATUS") return 7;
+    else if (cmd == "CREATE_ROOM") { ss >> a; return 8 + a.size(); }
+    else if (cmd == "JOIN_ROOM") { ss >> a; return 9 + a.size(); }
+    else if (cmd == "LEAVE_ROOM") { ss >> a; return 10 + a.size(); }
+    else if (cmd == "LIST_ROOMS") return 11;
+    else if (cmd == "ROOM_MEMBERS") { ss >> a; return 12 + a.size(); }
+    else if (cmd == "ROOM_MSG") { ss >> a; getline(ss, rest); return 13 + a.size() + rest.size(); }
+    else if (cmd == "ROOM_HISTORY") { ss >> a; return 14 + a.size(); }
+    return 0;
+}
+
+// 新版解析：string_view 切割 + 依長度分派
+static size_t fastParse(string_view command) {
+    CommandTokenizer args(command);
+    CommandVerb verb = CommandParser::lookupVerb(args.next());
+
+    int port = 0;
+    switch (verb) {
+    case CommandVerb::Register: { auto a = args.next(); auto b = args.next(); return 1 + a.size() + b.size(); }
+    case CommandVerb::Login: { auto a = args.next(); auto b = args.next(); args.nextInt(port); return 2 + a.size() + b.size() + port; }
+    case CommandVerb::Logout: return 3;
+    case CommandVerb::List: return 4;
+    case CommandVerb::Message: return 5 + args.rest().size();
+    case CommandVerb::GetUserInfo: return 6 + args.next().size();
+    case CommandVerb::EncryptionStatus: return 7;
+    case CommandVerb::CreateRoom: return 8 + args.next().size();
+    case CommandVerb::JoinRoom: return 9 + args.next().size();
+    case CommandVerb::LeaveRoom: return 10 + args.next().size();
+    case CommandVerb::ListRooms: return 11;
+    case CommandVerb::RoomMembers: return 12 + args.next().size();
+    case CommandVerb::RoomMsg: { auto a = args.next(); return 13 + a.size() + args.rest().size(); }
+    case CommandVerb::RoomHistory: return 14 + args.next().size();
+    default: return 0;
+    }
+}
+
+template <typename ParseFn>
+static void runBenchmark(const char* name, size_t iterations, ParseFn parse) {
+    size_t checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        checksum += parse(SAMPLE_COMMANDS[i % SAMPLE_COMMANDS.size()]);
+    }
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+    cout << "  " << name << ": " << (double)elapsed / iterations << " ns/command"
+         << " (checksum " << checksum << ")" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t iterations = 2000000;
+    if (argc > 1) {
+        iterations = stoul(argv[1]);
+    }
+
+    // 兩種解析結果必須一致
+    for (const string& command : SAMPLE_COMMANDS) {
+        if (legacyParse(command) != fastParse(command)) {
+            cerr << "❌ Parser mismatch: " << command << endl;
+            return 1;
+        }
+    }
+
+    cout << "=== Command Parser Benchmark (" << iterations << " commands) ===" << endl;
+    runBenchmark("stringstream + if/else", iterations, [](const string& c) { return legacyParse(c); });
+    runBenchmark("string_view + lookup  ", iterations, [](const string& c) { return fastParse(c); });
+    return 0;
+}
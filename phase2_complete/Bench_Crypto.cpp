@@ -0,0 +1,120 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "Crypto.h"
+
+using namespace std;
+
+/**
+ * 加密每則訊息成本微基準測試
+ *
+ * 比較每則訊息 EVP_CIPHER_CTX_new + 排金鑰 + free (舊版 Crypto) 與
+ * 重複使用已排好金鑰的 context、只重設 IV 的 AES-256-CBC 加解密時間，
+ * 另外列出 Crypto::encryptMessage + decryptMessage (含 Base64) 的完整成本。
+ * 用法: ./bench_crypto [iterations]
+ */
+
+// 與 Crypto::setDefaultKey 相同的 32 bytes (含結尾的 '\0')
+static const unsigned char* KEY = (const unsigned char*)"Phase2ChatEncryptionKey2025!!!!";
+
+// 加密後立刻解密一則訊息，回傳明文長度 (避免被最佳化掉)
+static size_t roundTrip(EVP_CIPHER_CTX* enc, EVP_CIPHER_CTX* dec, bool rekey,
+                        const string& message, vector<unsigned char>& cipher, vector<unsigned char>& plain) {
+    unsigned char iv[16];
+    RAND_bytes(iv, sizeof(iv));
+    const EVP_CIPHER* type = rekey ? EVP_aes_256_cbc() : NULL;
+    const unsigned char* key = rekey ? KEY : NULL;
+    int len = 0, total = 0;
+
+    EVP_EncryptInit_ex(enc, type, NULL, key, iv);
+    EVP_EncryptUpdate(enc, cipher.data(), &len, (const unsigned char*)message.data(), (int)message.size());
+    total = len;
+    EVP_EncryptFinal_ex(enc, cipher.data() + total, &len);
+    total += len;
+
+    int cipherLen = total;
+    EVP_DecryptInit_ex(dec, type, NULL, key, iv);
+    EVP_DecryptUpdate(dec, plain.data(), &len, cipher.data(), cipherLen);
+    total = len;
+    EVP_DecryptFinal_ex(dec, plain.data() + total, &len);
+    return (size_t)(total + len);
+}
+
+// 舊版：每則訊息都建立 context 並重新排金鑰
+static double benchFresh(const string& message, size_t iterations) {
+    vector<unsigned char> cipher(message.size() + 16), plain(message.size() + 16);
+    size_t sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        EVP_CIPHER_CTX* enc = EVP_CIPHER_CTX_new();
+        EVP_CIPHER_CTX* dec = EVP_CIPHER_CTX_new();
+        sink += roundTrip(enc, dec, true, message, cipher, plain);
+        EVP_CIPHER_CTX_free(enc);
+        EVP_CIPHER_CTX_free(dec);
+    }
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    if (sink != message.size() * iterations) cerr << "fresh round trip mismatch" << endl;
+    return (double)elapsed / iterations;
+}
+
+// 新版：context 與 key schedule 重複使用，每則訊息只重設 IV
+static double benchCached(const string& message, size_t iterations) {
+    vector<unsigned char> cipher(message.size() + 16), plain(message.size() + 16);
+    EVP_CIPHER_CTX* enc = EVP_CIPHER_CTX_new();
+    EVP_CIPHER_CTX* dec = EVP_CIPHER_CTX_new();
+    size_t sink = roundTrip(enc, dec, true, message, cipher, plain);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += roundTrip(enc, dec, false, message, cipher, plain);
+    }
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    EVP_CIPHER_CTX_free(enc);
+    EVP_CIPHER_CTX_free(dec);
+    if (sink != message.size() * (iterations + 1)) cerr << "cached round trip mismatch" << endl;
+    return (double)elapsed / iterations;
+}
+
+static double benchMessage(Crypto& crypto, const string& message, size_t iterations) {
+    size_t sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink += crypto.decryptMessage(crypto.encryptMessage(message)).size();
+    }
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    if (sink != message.size() * iterations) cerr << "Crypto round trip mismatch" << endl;
+    return (double)elapsed / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    size_t iterations = 200000;
+    if (argc > 1) {
+        iterations = strtoul(argv[1], nullptr, 10);
+        if (iterations == 0) iterations = 200000;
+    }
+    Logger::setLevel(LogLevel::Warn);
+    Crypto crypto;
+    if (!crypto.selfTest()) {
+        cerr << "Crypto self-test failed" << endl;
+        return 1;
+    }
+
+    cout << "=== AES-256-CBC encrypt + decrypt per message (" << iterations << " iterations, ns) ===" << endl;
+    cout << "  bytes   new ctx + key   cached ctx   Crypto (Base64)" << endl;
+    cout << fixed << setprecision(1);
+    const size_t sizes[] = {32, 128, 1024, 16384};
+    for (size_t size : sizes) {
+        string message(size, 'm');
+        size_t n = size > 1024 ? iterations / 16 : iterations;
+        double fresh = benchFresh(message, n);
+        double cached = benchCached(message, n);
+        double full = benchMessage(crypto, message, n);
+        cout << "  " << setw(5) << size << "   " << setw(13) << fresh << "   " << setw(10) << cached
+             << "   " << setw(15) << full << endl;
+    }
+    return 0;
+}
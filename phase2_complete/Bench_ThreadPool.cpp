@@ -0,0 +1,332 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ThreadPool.h"
+#include "Protocol.h"
+
+using namespace std;
+
+/**
+ * ThreadPool 排程競爭基準測試
+ *
+ * 比較共享佇列 (單一 mutex) 與工作竊取排程器在 1-64 個 worker 時的每任務成本：
+ *   external - 與 worker 同數量的外部執行緒同時 enqueue (類似事件迴圈送指令)
+ *   spawn    - 任務在 worker 內再 enqueue 子任務 (類似 drainConnection 重新排程)
+ * 另外比較 enqueue (future) 與 post (fire-and-forget) 的每任務成本與 heap 配置次數，
+ * 以及大量背景工作時延遲敏感任務的排隊時間 (全部 Normal vs High/Bulk 分級)，
+ * 與阻塞式 echo 處理函式以「一條連線一個執行緒」和 fiber 執行的比較，
+ * 逐一 post 與 enqueue_bulk 一次送出一批的每任務成本，以及 parallel_for 的加速
+ * 用法: ./bench_threadpool [tasks]
+ */
+
+// 計算 operator new 次數 (只在 post/enqueue 比較時讀取)
+static atomic<size_t> allocations(0);
+
+// noinline：避免 GCC 把 new/delete 內聯後誤判 malloc/free 不成對 (-Wmismatched-new-delete)
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size == 0 ? 1 : size)) return p;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+static void waitFor(const atomic<size_t>& done, size_t total) {
+    while (done.load(memory_order_acquire) < total) {
+        this_thread::yield();
+    }
+}
+
+// 外部生產者：producers 個執行緒各送出 total / producers 個空任務
+static double benchExternal(SchedulerKind kind, size_t threads, size_t total) {
+    ThreadPool pool(threads, kind);
+    atomic<size_t> done(0);
+    size_t producers = threads;
+    size_t perProducer = total / producers;
+    total = perProducer * producers;
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> senders;
+    for (size_t p = 0; p < producers; ++p) {
+        senders.emplace_back([&]() {
+            for (size_t i = 0; i < perProducer; ++i) {
+                pool.enqueue([&done]() { done.fetch_add(1, memory_order_release); });
+            }
+        });
+    }
+    for (thread& sender : senders) sender.join();
+    waitFor(done, total);
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    return (double)elapsed / total;
+}
+
+// 任務內產生子任務：每個根任務往下分裂成二元樹
+static void spawnTree(ThreadPool& pool, atomic<size_t>& done, int depth) {
+    done.fetch_add(1, memory_order_release);
+    if (depth == 0) return;
+    pool.enqueue([&pool, &done, depth]() { spawnTree(pool, done, depth - 1); });
+    pool.enqueue([&pool, &done, depth]() { spawnTree(pool, done, depth - 1); });
+}
+
+static double benchSpawn(SchedulerKind kind, size_t threads, size_t total) {
+    ThreadPool pool(threads, kind);
+    atomic<size_t> done(0);
+    const int depth = 9;  // 每棵樹 2^10 - 1 個任務
+    size_t perTree = (1u << (depth + 1)) - 1;
+    size_t trees = total / perTree + 1;
+    total = trees * perTree;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t t = 0; t < trees; ++t) {
+        pool.enqueue([&pool, &done, depth]() { spawnTree(pool, done, depth); });
+    }
+    waitFor(done, total);
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    return (double)elapsed / total;
+}
+
+// 單一生產者送出 total 個空任務，回傳 ns/task 與每任務配置次數
+struct SubmitResult {
+    double nsPerTask;
+    double allocsPerTask;
+};
+
+static SubmitResult benchSubmit(SchedulerKind kind, bool usePost, size_t total) {
+    ThreadPool pool(4, kind);
+    atomic<size_t> done(0);
+    // 先暖身讓 TaskNode 回收池有庫存
+    for (size_t i = 0; i < 1024; ++i) {
+        pool.post([&done]() { done.fetch_add(1, memory_order_release); });
+    }
+    waitFor(done, 1024);
+    done.store(0);
+
+    size_t before = allocations.load(memory_order_relaxed);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < total; ++i) {
+        if (usePost) {
+            pool.post([&done]() { done.fetch_add(1, memory_order_release); });
+        } else {
+            pool.enqueue([&done]() { done.fetch_add(1, memory_order_release); });
+        }
+    }
+    waitFor(done, total);
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    size_t allocated = allocations.load(memory_order_relaxed) - before;
+    return SubmitResult{(double)elapsed / total, (double)allocated / total};
+}
+
+// 每次送出 batch 個空任務 (逐一 post vs enqueue_bulk)，回傳 ns/task
+static double benchBulk(SchedulerKind kind, bool bulk, size_t total, size_t batch) {
+    ThreadPool pool(4, kind);
+    atomic<size_t> done(0);
+    auto task = [&done]() { done.fetch_add(1, memory_order_release); };
+    vector<decltype(task)> tasks(batch, task);
+
+    auto start = chrono::steady_clock::now();
+    size_t sent = 0;
+    for (; sent < total; sent += batch) {
+        if (bulk) {
+            pool.enqueue_bulk(tasks);
+        } else {
+            for (size_t i = 0; i < batch; ++i) pool.post(task);
+        }
+    }
+    waitFor(done, sent);
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    return (double)elapsed / sent;
+}
+
+// 對 n 個元素各做一次小計算 (類似對每個成員加密/編碼)，回傳 ms
+static double benchParallelFor(ThreadPool* pool, size_t n, size_t grain) {
+    vector<uint64_t> values(n);
+    auto work = [&values](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            uint64_t x = i + 1;
+            for (int r = 0; r < 64; ++r) x = x * 6364136223846793005ull + 1442695040888963407ull;
+            values[i] = x;
+        }
+    };
+    auto start = chrono::steady_clock::now();
+    if (pool != nullptr) {
+        pool->parallel_for(0, n, grain, work);
+    } else {
+        work(0, n);
+    }
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static void spin(chrono::microseconds duration) {
+    auto until = chrono::steady_clock::now() + duration;
+    while (chrono::steady_clock::now() < until) {
+    }
+}
+
+// 4 個 worker 被 2000 個 200us 的背景任務塞滿時，每 1ms 送一個互動任務，量測從送出到開始執行的時間
+// tiered=false 時全部用 Normal (等同單一 FIFO)
+static void benchPriority(SchedulerKind kind, bool tiered, double& p50, double& p99) {
+    ThreadPool pool(4, kind);
+    atomic<size_t> done(0);
+    const size_t bulkTasks = 2000;
+    const size_t probes = 100;
+    TaskPriority bulk = tiered ? TaskPriority::Bulk : TaskPriority::Normal;
+    TaskPriority high = tiered ? TaskPriority::High : TaskPriority::Normal;
+
+    for (size_t i = 0; i < bulkTasks; ++i) {
+        pool.post(bulk, [&done]() {
+            spin(chrono::microseconds(200));
+            done.fetch_add(1, memory_order_release);
+        });
+    }
+    vector<double> latencies(probes);
+    for (size_t i = 0; i < probes; ++i) {
+        auto sent = chrono::steady_clock::now();
+        pool.post(high, [&done, &latencies, i, sent]() {
+            latencies[i] = chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count();
+            done.fetch_add(1, memory_order_release);
+        });
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    waitFor(done, bulkTasks + probes);
+    sort(latencies.begin(), latencies.end());
+    p50 = latencies[probes / 2];
+    p99 = latencies[probes * 99 / 100];
+}
+
+// 阻塞式 echo 處理函式 (與 P2P 連線處理相同的寫法：recvFrame/sendFrame 直到對方關閉)
+static void echoSession(int fd) {
+    string frame;
+    while (Protocol::recvFrame(fd, frame)) {
+        if (!Protocol::sendFrame(fd, frame)) break;
+    }
+    close(fd);
+}
+
+// sessions 條 socketpair，每條來回 rounds 次 64 bytes；客戶端固定是另一組 fiber，
+// 服務端是 sessions 個執行緒或 ThreadPool 的 fiber。回傳每秒來回次數
+static double benchSessions(bool useFibers, size_t sessions, size_t rounds) {
+    ThreadPool pool(ThreadPoolSizing::fixed(1));
+    FiberScheduler clients(2);
+    vector<thread> threads;
+    atomic<size_t> done(0);
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < sessions; ++i) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+            cerr << "socketpair failed" << endl;
+            break;
+        }
+        int serverFd = fds[0];
+        if (useFibers) {
+            pool.spawnFiber([serverFd]() { echoSession(serverFd); });
+        } else {
+            threads.emplace_back([serverFd]() { echoSession(serverFd); });
+        }
+        int clientFd = fds[1];
+        clients.spawn([clientFd, rounds, &done]() {
+            string payload(64, 'x'), reply;
+            for (size_t r = 0; r < rounds; ++r) {
+                if (!Protocol::sendFrame(clientFd, payload) || !Protocol::recvFrame(clientFd, reply)) break;
+            }
+            close(clientFd);
+            done.fetch_add(1, memory_order_release);
+        });
+    }
+    while (done.load(memory_order_acquire) < sessions) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return (double)(sessions * rounds) / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    size_t tasks = 200000;
+    if (argc > 1) {
+        tasks = strtoul(argv[1], nullptr, 10);
+        if (tasks == 0) tasks = 200000;
+    }
+    Logger::setLevel(LogLevel::Warn);
+
+    const size_t threadCounts[] = {1, 2, 4, 8, 16, 32, 64};
+    cout << "=== ThreadPool Scheduler Benchmark (" << tasks << " tasks, "
+         << thread::hardware_concurrency() << " CPUs) ===" << endl;
+    cout << "  ns/task      shared(ext)  steal(ext)   shared(spawn) steal(spawn)" << endl;
+    cout << fixed << setprecision(1);
+    for (size_t threads : threadCounts) {
+        double sharedExt = benchExternal(SchedulerKind::SharedQueue, threads, tasks);
+        double stealExt = benchExternal(SchedulerKind::WorkStealing, threads, tasks);
+        double sharedSpawn = benchSpawn(SchedulerKind::SharedQueue, threads, tasks);
+        double stealSpawn = benchSpawn(SchedulerKind::WorkStealing, threads, tasks);
+        cout << "  " << setw(2) << threads << " workers  "
+             << setw(11) << sharedExt << "  " << setw(10) << stealExt << "   "
+             << setw(12) << sharedSpawn << "  " << setw(11) << stealSpawn << endl;
+    }
+
+    cout << endl << "=== enqueue vs post (1 producer, 4 workers) ===" << endl;
+    cout << "                         ns/task  allocs/task" << endl;
+    const SchedulerKind kinds[] = {SchedulerKind::SharedQueue, SchedulerKind::WorkStealing};
+    for (SchedulerKind kind : kinds) {
+        for (int usePost = 0; usePost <= 1; ++usePost) {
+            SubmitResult result = benchSubmit(kind, usePost != 0, tasks);
+            cout << "  " << left << setw(13) << ThreadPool::schedulerName(kind) << right << " "
+                 << (usePost ? "post   " : "enqueue") << setw(7) << result.nsPerTask
+                 << "  " << setw(11) << setprecision(2) << result.allocsPerTask
+                 << setprecision(1) << endl;
+        }
+    }
+
+    cout << endl << "=== post loop vs enqueue_bulk (batches of 256, 4 workers) ===" << endl;
+    cout << "                         ns/task" << endl;
+    for (SchedulerKind kind : kinds) {
+        for (int bulk = 0; bulk <= 1; ++bulk) {
+            double ns = benchBulk(kind, bulk != 0, tasks, 256);
+            cout << "  " << left << setw(13) << ThreadPool::schedulerName(kind) << right << " "
+                 << (bulk ? "bulk   " : "post   ") << setw(7) << ns << endl;
+        }
+    }
+
+    cout << endl << "=== parallel_for over 1M items (grain 4096, ms) ===" << endl;
+    cout << "  serial      " << setw(7) << benchParallelFor(nullptr, 1000000, 4096) << endl;
+    for (SchedulerKind kind : kinds) {
+        ThreadPool pool(4, kind);
+        cout << "  " << left << setw(13) << ThreadPool::schedulerName(kind) << right
+             << setw(6) << benchParallelFor(&pool, 1000000, 4096) << endl;
+    }
+
+    cout << endl << "=== Interactive task wait under bulk load (4 workers, us) ===" << endl;
+    cout << "                         p50        p99" << endl;
+    for (SchedulerKind kind : kinds) {
+        for (int tiered = 0; tiered <= 1; ++tiered) {
+            double p50 = 0, p99 = 0;
+            benchPriority(kind, tiered != 0, p50, p99);
+            cout << "  " << left << setw(13) << ThreadPool::schedulerName(kind) << right << " "
+                 << (tiered ? "tiered " : "fifo   ") << setw(8) << p50 << "  " << setw(9) << p99 << endl;
+        }
+    }
+
+    cout << endl << "=== Blocking echo sessions: thread per session vs fibers (20 round trips each) ===" << endl;
+    cout << "  sessions   threads(rt/s)   fibers(rt/s)   fiber carriers" << endl;
+    const size_t sessionCounts[] = {100, 1000, 4000};
+    for (size_t sessions : sessionCounts) {
+        double threaded = benchSessions(false, sessions, 20);
+        double fibered = benchSessions(true, sessions, 20);
+        cout << "  " << setw(8) << sessions << "   " << setw(13) << setprecision(0) << threaded
+             << "   " << setw(12) << fibered << "   " << setw(14) << FiberScheduler::defaultCarriers()
+             << setprecision(1) << endl;
+    }
+    return 0;
+}
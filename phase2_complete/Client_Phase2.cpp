@@ -6,6 +6,11 @@
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <map>
+#include <future>
+#include <chrono>
+#include <sstream>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -14,6 +19,7 @@
 #include <sys/select.h>
 #include "P2PClient.h"
 #include "Crypto.h"
+#include "Protocol.h"
 
 using namespace std;
 
@@ -25,7 +31,26 @@ private:
     int myListenPort;
     bool isLoggedIn;
     string currentUser;
-    string incomingBuffer;
+    
+    // Server 訊框解碼 (只由接收執行緒使用)
+    FrameDecoder decoder;
+    mutex send_mutex;
+    
+    // 進行中的指令：request ID -> 等待回應的 promise (pending_mutex 保護)
+    // 指令以 "#<id> <command>" 送出，Server 回應時帶回相同的 ID，
+    // 因此可以同時送出多個指令；沒有 ID 的回應無法判斷屬於哪個指令，不會交給任何等待者
+    mutex pending_mutex;
+    map<uint64_t, promise<string>> pendingRequests;
+    uint64_t nextRequestId;
+    atomic<bool> connected{false};
+    
+    // LIST / LIST_ROOMS 的本地快取 (版本號 + 上次的完整清單)
+    struct CachedDirectory {
+        uint64_t version = 0;
+        string listing;
+    };
+    CachedDirectory userDirectory;
+    CachedDirectory roomDirectory;
     
     // P2P通訊支援
     unique_ptr<P2PClient> p2pClient;
@@ -35,14 +60,14 @@ private:
     bool encryptionEnabled;
     bool serverSupportsEncryption;
     
-    // 非同步訊息接收
+    // 接收執行緒：唯一讀取 server socket 的地方，分派回應與推播
     thread receiveThread;
     atomic<bool> receiving{false};
     
 public:
     ChatClient(string ip, int port) 
-        : serverIP(ip), serverPort(port), myListenPort(0), isLoggedIn(false),
-          encryptionEnabled(true), serverSupportsEncryption(false) {
+        : clientSocket(-1), serverIP(ip), serverPort(port), myListenPort(0), isLoggedIn(false),
+          nextRequestId(1), encryptionEnabled(true), serverSupportsEncryption(false) {
         
         cout << "=== Phase 2 Complete Chat Client ===" << endl;
         cout << "Features:" << endl;
@@ -82,6 +107,9 @@ public:
         
         cout << "Connected to server " << serverIP << ":" << serverPort << endl;
         
+        connected = true;
+        startReceiving();
+        
         if (encryptionEnabled) {
             checkServerEncryption();
         }
@@ -100,53 +128,139 @@ public:
         }
     }
     
-    string sendCommandRaw(const string& command) {
-        const char* data = command.c_str();
-        ssize_t sent = send(clientSocket, data, command.length(), 0);
-        if (sent <= 0) return "ERROR: Send failed";
-        
-        char buffer[4096];
-        memset(buffer, 0, sizeof(buffer));
-        ssize_t received = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-        if (received <= 0) return "ERROR: Receive failed";
-        
-        return string(buffer);
+    static bool isPushMessage(const string& msg) {
+        return msg.find("ROOM_MSG:") == 0 || msg.find("ROOM_NOTIFICATION:") == 0;
     }
     
-    string sendCommand(const string& command) {
-        string messageToSend = command;
-        bool useEncryption = encryptionEnabled && serverSupportsEncryption;
+    string decryptIfNeeded(const string& msg) {
+        if (Crypto::isEncryptedMessage(msg)) {
+            string decrypted = crypto.decryptMessage(msg);
+            if (!decrypted.empty()) {
+                return decrypted;
+            }
+        }
+        return msg;
+    }
+    
+    void displayPush(const string& msg) {
+        cout << "\n📢 " << msg << endl;
+        cout << "Enter command: " << flush;
+    }
+    
+    // 送出中的指令：request ID 與其回應 (ID 為 0 表示沒有登記，例如尚未連線)
+    struct PendingResponse {
+        uint64_t requestId;
+        future<string> response;
+    };
+    
+    /**
+     * 非同步送出指令
+     * 
+     * @param command 指令內容
+     * @param encrypt 是否加密 (依 server 是否支援)
+     * @return 指令的 request ID 與回應的 future，可同時有多個指令在途中
+     */
+    PendingResponse sendCommandAsync(const string& command, bool encrypt = true) {
+        promise<string> result;
+        future<string> response = result.get_future();
+        
+        if (!connected) {
+            result.set_value("ERROR: Send failed");
+            return {0, std::move(response)};
+        }
+        
+        uint64_t requestId;
+        {
+            lock_guard<mutex> lock(pending_mutex);
+            requestId = nextRequestId++;
+            pendingRequests.emplace(requestId, std::move(result));
+        }
         
-        if (useEncryption) {
-            string encrypted = crypto.encryptMessage(command);
+        string messageToSend = "#" + to_string(requestId) + " " + command;
+        if (encrypt && encryptionEnabled && serverSupportsEncryption) {
+            string encrypted = crypto.encryptMessage(messageToSend);
             if (!encrypted.empty()) {
                 messageToSend = encrypted;
             }
         }
         
-        const char* data = messageToSend.c_str();
-        ssize_t sent = send(clientSocket, data, messageToSend.length(), 0);
-        if (sent <= 0) return "ERROR: Send failed";
-        
-        char buffer[4096];
-        memset(buffer, 0, sizeof(buffer));
-        ssize_t received = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-        if (received <= 0) return "ERROR: Receive failed";
-        
-        string response(buffer);
-        
-        // 解密回應
-        if (Crypto::isEncryptedMessage(response)) {
-            string decrypted = crypto.decryptMessage(response);
-            if (!decrypted.empty()) {
-                response = decrypted;
+        bool sent;
+        {
+            lock_guard<mutex> lock(send_mutex);
+            sent = Protocol::sendFrame(clientSocket, messageToSend);
+        }
+        if (!sent) {
+            completeRequest(requestId, "ERROR: Send failed");
+        }
+        return {requestId, std::move(response)};
+    }
+    
+    string sendCommandRaw(const string& command) {
+        return waitResponse(sendCommandAsync(command, false));
+    }
+    
+    string sendCommand(const string& command) {
+        return waitResponse(sendCommandAsync(command));
+    }
+    
+    // 等待回應；逾時就撤銷登記，之後才到的回應直接丟棄
+    string waitResponse(PendingResponse pending) {
+        if (pending.response.wait_for(chrono::seconds(10)) != future_status::ready) {
+            lock_guard<mutex> lock(pending_mutex);
+            if (pendingRequests.erase(pending.requestId) > 0) {
+                return "ERROR: Response timeout";
             }
+            // 撤銷前回應剛好到達，promise 已完成
+        }
+        return pending.response.get();
+    }
+    
+    // 以 request ID 完成指令 (已逾時撤銷的 ID 找不到，回應直接丟棄)
+    void completeRequest(uint64_t requestId, const string& response) {
+        lock_guard<mutex> lock(pending_mutex);
+        auto it = pendingRequests.find(requestId);
+        if (it == pendingRequests.end()) return;
+        it->second.set_value(response);
+        pendingRequests.erase(it);
+    }
+    
+    void failAllRequests(const string& error) {
+        lock_guard<mutex> lock(pending_mutex);
+        for (auto& pair : pendingRequests) {
+            pair.second.set_value(error);
+        }
+        pendingRequests.clear();
+    }
+    
+    // 分派收到的訊框：推播直接顯示，回應依 request ID 交給等待中的指令
+    void dispatchFrame(const string& frame) {
+        string msg = decryptIfNeeded(frame);
+        if (isPushMessage(msg)) {
+            displayPush(msg);
+            return;
         }
         
-        return response;
+        uint64_t requestId = 0;
+        if (!msg.empty() && msg[0] == '#') {
+            size_t space = msg.find(' ');
+            try {
+                requestId = stoull(msg.substr(1, space == string::npos ? string::npos : space - 1));
+            } catch (const exception&) {
+                requestId = 0;
+            }
+            msg = (space == string::npos) ? "" : msg.substr(space + 1);
+        }
+        if (requestId == 0) {
+            // 沒有 ID 的回應 (例如 "ERROR: Decryption failed") 不知道屬於哪個指令，
+            // 直接顯示給使用者；對應的指令會逾時失敗，而不是拿到別人的回應
+            cerr << "\n⚠️ Unmatched server reply: " << msg << endl;
+            cout << "Enter command: " << flush;
+            return;
+        }
+        completeRequest(requestId, msg);
     }
     
-    // 啟動非同步接收群組訊息
+    // 啟動接收執行緒 (連線後立即啟動，直到 client 結束)
     void startReceiving() {
         receiving = true;
         receiveThread = thread([this]() {
@@ -161,37 +275,27 @@ public:
                 tv.tv_usec = 0;
                 
                 int result = select(clientSocket + 1, &readfds, NULL, NULL, &tv);
-                if (result > 0 && FD_ISSET(clientSocket, &readfds)) {
-                    memset(buffer, 0, sizeof(buffer));
-                    int received = recv(clientSocket, buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
-                    if (received > 0) {
-                        // 1. 將收到的資料加入緩衝區
-                        incomingBuffer.append(buffer, received);
-                        
-                        // 2. 檢查是否有完整的訊息（以 \n 分割）
-                        size_t pos = 0;
-                        while ((pos = incomingBuffer.find('\n')) != string::npos) {
-                            // 取出一條完整訊息
-                            string msg = incomingBuffer.substr(0, pos);
-                            // 從緩衝區移除這條訊息和換行符
-                            incomingBuffer.erase(0, pos + 1);
-                            
-                            // 3. 原本的解密與處理邏輯移到這裡
-                            if (Crypto::isEncryptedMessage(msg)) {
-                                string decrypted = crypto.decryptMessage(msg);
-                                if (!decrypted.empty()) {
-                                    msg = decrypted;
-                                }
-                            }
-                            
-                            if (msg.find("ROOM_MSG:") == 0 || msg.find("ROOM_NOTIFICATION:") == 0) {
-                                cout << "\n📢 " << msg << endl;
-                                cout << "Enter command: " << flush;
-                            }
-                        }
-                    }
+                if (result <= 0 || !FD_ISSET(clientSocket, &readfds)) continue;
+                
+                ssize_t received = recv(clientSocket, buffer, sizeof(buffer), 0);
+                if (received < 0 && errno == EINTR) continue;
+                if (received <= 0) {
+                    break;
+                }
+                decoder.feed(buffer, received);
+                
+                string frame;
+                while (decoder.next(frame)) {
+                    dispatchFrame(frame);
+                }
+                if (decoder.hasError()) {
+                    break;
                 }
             }
+            
+            // 連線中斷：讓所有等待中的指令結束
+            connected = false;
+            failAllRequests("ERROR: Receive failed");
         });
     }
     
@@ -289,9 +393,6 @@ public:
                 cout << "✅ P2P ready for messages and file transfers" << endl;
             }
             
-            // 啟動非同步接收
-            startReceiving();
-            
             return true;
         }
         return false;
@@ -302,7 +403,6 @@ public:
         cout << "Server: " << response << endl;
         
         if (response == "LOGOUT_SUCCESS") {
-            stopReceiving();
             if (p2pClient) {
                 p2pClient.reset();
             }
@@ -315,8 +415,50 @@ public:
     }
     
     void handleListUsers() {
-        string response = sendCommand("LIST");
-        cout << "📋 " << response << endl;
+        cout << "📋 " << fetchDirectory("LIST", userDirectory) << endl;
+    }
+    
+    /**
+     * 取得 LIST / LIST_ROOMS 目錄
+     * 
+     * 帶上次看到的版本號查詢：沒變時 server 只回 NOT_MODIFIED，
+     * 有變時依游標逐頁取回，最後組回舊格式的完整清單
+     */
+    string fetchDirectory(const string& command, CachedDirectory& cache) {
+        string listing;
+        string prefix;
+        string after;
+        uint64_t version = 0;
+        
+        while (true) {
+            string request = command + " " + to_string(cache.version);
+            if (!after.empty()) request += " " + after;
+            string response = sendCommand(request);
+            
+            if (response.compare(0, 13, "NOT_MODIFIED ") == 0 && after.empty()) {
+                return cache.listing + " (unchanged)";
+            }
+            
+            // "<PREFIX> <version> <next|END>: entry entry ..."
+            size_t colon = response.find(':');
+            istringstream header(response.substr(0, colon == string::npos ? 0 : colon));
+            string next;
+            if (!(header >> prefix >> version >> next)) {
+                return response;
+            }
+            listing += response.substr(colon + 1);
+            
+            if (next == "END") break;
+            after = next;
+        }
+        
+        if (listing.empty()) {
+            cache.listing = (prefix == "ROOMS") ? "No rooms available" : "No users online";
+        } else {
+            cache.listing = prefix + ":" + listing;
+        }
+        cache.version = version;
+        return cache.listing;
     }
     
     // ========== P2P 功能 ==========
@@ -377,8 +519,7 @@ public:
     // ========== 群組聊天 ==========
     
     void handleListRooms() {
-        string response = sendCommand("LIST_ROOMS");
-        cout << "📋 " << response << endl;
+        cout << "📋 " << fetchDirectory("LIST_ROOMS", roomDirectory) << endl;
     }
     
     void handleCreateRoom() {
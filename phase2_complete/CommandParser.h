@@ -0,0 +1,148 @@
+#ifndef COMMAND_PARSER_H
+#define COMMAND_PARSER_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <charconv>
+
+/**
+ * Phase 2: 零配置指令解析 (Zero-allocation Command Parser)
+ *
+ * - CommandTokenizer 直接在收到的訊息上切出 string_view，不複製任何字串
+ * - lookupVerb 依長度 switch 後比對一次，編譯期即可求值
+ * - 動詞不分大小寫 (與舊版 transform(::toupper) 相同)
+ */
+
+enum class CommandVerb : uint8_t {
+    Unknown = 0,
+    Register,
+    Login,
+    Logout,
+    List,
+    Message,
+    GetUserInfo,
+    EncryptionStatus,
+    CreateRoom,
+    JoinRoom,
+    LeaveRoom,
+    ListRooms,
+    RoomMembers,
+    RoomMsg,
+    RoomHistory,
+    Count
+};
+
+class CommandTokenizer {
+private:
+    std::string_view input;
+    size_t pos;
+
+    static constexpr bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    void skipSpaces() {
+        while (pos < input.size() && isSpace(input[pos])) ++pos;
+    }
+
+public:
+    explicit CommandTokenizer(std::string_view text) : input(text), pos(0) {}
+
+    // 下一個以空白分隔的 token，沒有時回傳空的 view
+    std::string_view next() {
+        skipSpaces();
+        size_t start = pos;
+        while (pos < input.size() && !isSpace(input[pos])) ++pos;
+        return input.substr(start, pos - start);
+    }
+
+    // 解析下一個整數，格式錯誤時回傳 false
+    template <typename T>
+    bool nextInt(T& value) {
+        skipSpaces();
+        const char* begin = input.data() + pos;
+        const char* end = input.data() + input.size();
+        auto result = std::from_chars(begin, end, value);
+        if (result.ec != std::errc() || result.ptr == begin) return false;
+        pos += result.ptr - begin;
+        return true;
+    }
+
+    // 剩下的全部內容 (保留前導空白，與 getline 相同)
+    std::string_view rest() {
+        std::string_view remaining = input.substr(pos);
+        pos = input.size();
+        return remaining;
+    }
+};
+
+class CommandParser {
+public:
+    static constexpr char toUpper(char c) {
+        return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+    }
+
+    // 不分大小寫比對 (expected 必須是大寫)
+    static constexpr bool equalsVerb(std::string_view text, std::string_view expected) {
+        if (text.size() != expected.size()) return false;
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (toUpper(text[i]) != expected[i]) return false;
+        }
+        return true;
+    }
+
+    // 動詞 -> CommandVerb：先依長度分流，每個長度最多兩個候選
+    static constexpr CommandVerb lookupVerb(std::string_view verb) {
+        switch (verb.size()) {
+        case 4:
+            return equalsVerb(verb, "LIST") ? CommandVerb::List : CommandVerb::Unknown;
+        case 5:
+            return equalsVerb(verb, "LOGIN") ? CommandVerb::Login : CommandVerb::Unknown;
+        case 6:
+            return equalsVerb(verb, "LOGOUT") ? CommandVerb::Logout : CommandVerb::Unknown;
+        case 7:
+            return equalsVerb(verb, "MESSAGE") ? CommandVerb::Message : CommandVerb::Unknown;
+        case 8:
+            if (equalsVerb(verb, "REGISTER")) return CommandVerb::Register;
+            return equalsVerb(verb, "ROOM_MSG") ? CommandVerb::RoomMsg : CommandVerb::Unknown;
+        case 9:
+            return equalsVerb(verb, "JOIN_ROOM") ? CommandVerb::JoinRoom : CommandVerb::Unknown;
+        case 10:
+            if (equalsVerb(verb, "LEAVE_ROOM")) return CommandVerb::LeaveRoom;
+            return equalsVerb(verb, "LIST_ROOMS") ? CommandVerb::ListRooms : CommandVerb::Unknown;
+        case 11:
+            return equalsVerb(verb, "CREATE_ROOM") ? CommandVerb::CreateRoom : CommandVerb::Unknown;
+        case 12:
+            if (equalsVerb(verb, "ROOM_MEMBERS")) return CommandVerb::RoomMembers;
+            return equalsVerb(verb, "ROOM_HISTORY") ? CommandVerb::RoomHistory : CommandVerb::Unknown;
+        case 13:
+            return equalsVerb(verb, "GET_USER_INFO") ? CommandVerb::GetUserInfo : CommandVerb::Unknown;
+        case 17:
+            return equalsVerb(verb, "ENCRYPTION_STATUS") ? CommandVerb::EncryptionStatus : CommandVerb::Unknown;
+        default:
+            return CommandVerb::Unknown;
+        }
+    }
+
+    // 整個 token 都必須是數字
+    template <typename T>
+    static bool parseInt(std::string_view text, T& value) {
+        const char* end = text.data() + text.size();
+        auto result = std::from_chars(text.data(), end, value);
+        return !text.empty() && result.ec == std::errc() && result.ptr == end;
+    }
+
+    // 錯誤訊息用：轉成大寫的動詞 (只在未知指令時才配置)
+    static std::string upperVerb(std::string_view verb) {
+        std::string result(verb);
+        for (char& c : result) c = toUpper(c);
+        return result;
+    }
+};
+
+static_assert(CommandParser::lookupVerb("room_msg") == CommandVerb::RoomMsg, "verb lookup is case-insensitive");
+static_assert(CommandParser::lookupVerb("LIST_ROOMS") == CommandVerb::ListRooms, "verb lookup by length");
+static_assert(CommandParser::lookupVerb("LISTS") == CommandVerb::Unknown, "unknown verb");
+
+#endif // COMMAND_PARSER_H
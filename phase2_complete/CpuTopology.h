@@ -0,0 +1,156 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <cctype>
+#include <cstdlib>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/**
+ * Phase 2: CPU 拓撲與執行緒配置 (CPU Topology & Placement)
+ *
+ * - CPU 清單使用 Linux cpulist 格式 ("0-3,8,10-11")，與 /sys 與 taskset 相同
+ * - allowedCpus：行程可用的 CPU (尊重 taskset/cgroup 的限制)
+ * - nodeCpus：NUMA 節點的 CPU (/sys/devices/system/node/node<N>/cpulist)
+ * - 固定執行緒只在 Linux 支援，其他平台 pin 會回傳 false (執行緒照常浮動)
+ */
+class CpuTopology {
+public:
+    // 解析 "0-3,8"；格式錯誤回傳 false。結果排序且不重複
+    static bool parseList(const std::string& text, std::vector<int>& cpus) {
+        cpus.clear();
+        std::stringstream stream(text);
+        std::string part;
+        while (std::getline(stream, part, ',')) {
+            part.erase(std::remove_if(part.begin(), part.end(), ::isspace), part.end());
+            if (part.empty()) continue;
+            size_t dash = part.find('-');
+            int first = 0, last = 0;
+            if (!parseCpu(part.substr(0, dash), first)) return false;
+            last = first;
+            if (dash != std::string::npos && !parseCpu(part.substr(dash + 1), last)) return false;
+            if (last < first) return false;
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        }
+        normalize(cpus);
+        return !cpus.empty();
+    }
+
+    static std::string formatList(const std::vector<int>& cpus) {
+        std::string text;
+        for (size_t i = 0; i < cpus.size();) {
+            size_t j = i;
+            while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+            if (!text.empty()) text += ",";
+            text += std::to_string(cpus[i]);
+            if (j > i) text += "-" + std::to_string(cpus[j]);
+            i = j + 1;
+        }
+        return text.empty() ? "-" : text;
+    }
+
+    static std::vector<int> allowedCpus() {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        if (sched_getaffinity(0, sizeof(cpuset), &cpuset) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &cpuset)) cpus.push_back(cpu);
+            }
+        }
+#endif
+        if (cpus.empty()) {
+            unsigned int count = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned int cpu = 0; cpu < count; ++cpu) cpus.push_back((int)cpu);
+        }
+        return cpus;
+    }
+
+    // 節點不存在 (或非 Linux) 時回傳空的清單
+    static std::vector<int> nodeCpus(int node) {
+        std::vector<int> cpus;
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string line;
+        if (file && std::getline(file, line)) {
+            parseList(line, cpus);
+        }
+        return cpus;
+    }
+
+    static std::vector<int> intersect(const std::vector<int>& a, const std::vector<int>& b) {
+        std::vector<int> result;
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        return result;
+    }
+
+    static std::vector<int> subtract(const std::vector<int>& a, const std::vector<int>& b) {
+        std::vector<int> result;
+        std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        return result;
+    }
+
+    // 將目前執行緒限制在 cpus 上 (只有一個 CPU 時即固定在該核心)
+    static bool pinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+        if (cpus.empty()) return false;
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &cpuset);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) == 0;
+#else
+        (void)cpus;
+        return false;
+#endif
+    }
+
+private:
+    static bool parseCpu(const std::string& text, int& cpu) {
+        if (text.empty() || text.size() > 5) return false;
+        for (char c : text) {
+            if (c < '0' || c > '9') return false;
+        }
+        cpu = std::atoi(text.c_str());
+        return true;
+    }
+
+    static void normalize(std::vector<int>& cpus) {
+        std::sort(cpus.begin(), cpus.end());
+        cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    }
+};
+
+// 一組執行緒 (例如 ThreadPool 的 worker) 的 CPU 配置
+struct CpuPlacement {
+    std::vector<int> cpus;     // 空 = 不限制 (由 OS 排程)
+    bool perThread = false;    // true: 第 i 個執行緒固定在 cpus[i % n]；false: 在整組 cpus 內浮動
+
+    bool enabled() const { return !cpus.empty(); }
+
+    // 在執行緒內呼叫
+    bool apply(size_t index) const {
+        if (!enabled()) return true;
+        if (perThread) {
+            return CpuTopology::pinCurrentThread(std::vector<int>{cpus[index % cpus.size()]});
+        }
+        return CpuTopology::pinCurrentThread(cpus);
+    }
+
+    std::string describe() const {
+        if (!enabled()) return "floating";
+        return "CPUs " + CpuTopology::formatList(cpus) + (perThread ? " (one core each)" : " (shared set)");
+    }
+};
+
+#endif // CPU_TOPOLOGY_H
@@ -1,11 +1,13 @@
 #ifndef CRYPTO_H
 #define CRYPTO_H
 
-#include <iostream>
+#include "Logger.h"
 #include <string>
 #include <vector>
 #include <cstring>
 #include <stdexcept>
+#include <mutex>
+#include <openssl/crypto.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/err.h>
@@ -17,6 +19,8 @@
  * - 支援 P2P 訊息加密
  * - 支援 Client-Server 通訊加密
  * - 自動處理 IV (Initialization Vector)
+ * - OpenSSL 初始化與自我測試整個行程只做一次
+ * - 每個執行緒快取一組已排好金鑰的 cipher context，每則訊息只重設 IV
  */
 
 class Crypto {
@@ -37,7 +41,7 @@ private:
         unsigned long errCode;
         while ((errCode = ERR_get_error())) {
             char* err = ERR_error_string(errCode, NULL);
-            std::cerr << "OpenSSL Error: " << err << std::endl;
+            LOG_SAMPLED(LogLevel::Error, 10, "OpenSSL Error: " << err);
         }
     }
     
@@ -127,12 +131,70 @@ private:
     static inline bool is_base64(unsigned char c) {
         return (isalnum(c) || (c == '+') || (c == '/'));
     }
+    
+    // 每個執行緒的 cipher context (加密、解密各一)，記住排好的是哪一把金鑰
+    struct CipherContext {
+        EVP_CIPHER_CTX* ctx = nullptr;
+        unsigned char key[KEY_SIZE];
+        bool keyed = false;
+        
+        ~CipherContext() {
+            if (ctx) EVP_CIPHER_CTX_free(ctx);
+            OPENSSL_cleanse(key, KEY_SIZE);
+        }
+    };
+    
+    struct ThreadContexts {
+        CipherContext encrypt;
+        CipherContext decrypt;
+    };
+    
+    static ThreadContexts& threadContexts() {
+        thread_local ThreadContexts contexts;
+        return contexts;
+    }
+    
+    // 取得以本實例金鑰排好、並設定 iv 的 context；失敗回傳 nullptr
+    // 金鑰與上次相同時不傳 cipher/key，OpenSSL 沿用已排好的 key schedule，只重設 IV 與狀態
+    EVP_CIPHER_CTX* prepareContext(CipherContext& cached, bool encrypting, const unsigned char* iv) {
+        if (!cached.ctx) {
+            cached.ctx = EVP_CIPHER_CTX_new();
+            if (!cached.ctx) return nullptr;
+        }
+        bool reuse = cached.keyed && memcmp(cached.key, key, KEY_SIZE) == 0;
+        const EVP_CIPHER* cipher = reuse ? NULL : EVP_aes_256_cbc();
+        const unsigned char* keyData = reuse ? NULL : key;
+        int ok = encrypting ? EVP_EncryptInit_ex(cached.ctx, cipher, NULL, keyData, iv)
+                            : EVP_DecryptInit_ex(cached.ctx, cipher, NULL, keyData, iv);
+        if (ok != 1) {
+            cached.keyed = false;
+            return nullptr;
+        }
+        if (!reuse) {
+            memcpy(cached.key, key, KEY_SIZE);
+            cached.keyed = true;
+        }
+        return cached.ctx;
+    }
+    
+    // OpenSSL 1.1 之後由程式結束時自動清理，不再由個別實例呼叫 EVP_cleanup
+    static void initLibrary() {
+        static std::once_flag once;
+        std::call_once(once, [] {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+            OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CRYPTO_STRINGS | OPENSSL_INIT_ADD_ALL_CIPHERS |
+                                OPENSSL_INIT_ADD_ALL_DIGESTS, NULL);
+#else
+            OpenSSL_add_all_algorithms();
+            ERR_load_crypto_strings();
+#endif
+        });
+    }
 
 public:
     Crypto() : keyInitialized(false) {
-        // 初始化 OpenSSL
-        OpenSSL_add_all_algorithms();
-        ERR_load_crypto_strings();
+        // 初始化 OpenSSL (整個行程一次)
+        initLibrary();
         
         // 設定預設金鑰 (從固定字串派生)
         setDefaultKey();
@@ -144,25 +206,25 @@ public:
         const char* keyStr = "Phase2ChatEncryptionKey2025!!!!";
         memcpy(key, keyStr, KEY_SIZE);
         keyInitialized = true;
-        std::cout << "🔐 Crypto: Default encryption key initialized" << std::endl;
+        LOG_INFO("🔐 Crypto: Default encryption key initialized");
     }
     
     // 設定自定義金鑰
     bool setKey(const std::string& keyString) {
         if (keyString.length() < KEY_SIZE) {
-            std::cerr << "Crypto: Key must be at least " << KEY_SIZE << " bytes" << std::endl;
+            LOG_ERROR("Crypto: Key must be at least " << KEY_SIZE << " bytes");
             return false;
         }
         memcpy(key, keyString.c_str(), KEY_SIZE);
         keyInitialized = true;
-        std::cout << "🔐 Crypto: Custom encryption key set" << std::endl;
+        LOG_INFO("🔐 Crypto: Custom encryption key set");
         return true;
     }
     
     // 設定金鑰 (從 bytes)
     bool setKey(const unsigned char* keyData, size_t keyLen) {
         if (keyLen < KEY_SIZE) {
-            std::cerr << "Crypto: Key must be at least " << KEY_SIZE << " bytes" << std::endl;
+            LOG_ERROR("Crypto: Key must be at least " << KEY_SIZE << " bytes");
             return false;
         }
         memcpy(key, keyData, KEY_SIZE);
@@ -178,7 +240,7 @@ public:
      */
     std::string encrypt(const std::string& plaintext) {
         if (!keyInitialized) {
-            std::cerr << "Crypto: Key not initialized" << std::endl;
+            LOG_ERROR("Crypto: Key not initialized");
             return "";
         }
         
@@ -190,20 +252,14 @@ public:
                 return "";
             }
             
-            // 準備加密
-            EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+            // 準備加密 (本執行緒快取的 context，只重設 IV)
+            CipherContext& cached = threadContexts().encrypt;
+            EVP_CIPHER_CTX* ctx = prepareContext(cached, true, iv);
             if (!ctx) {
                 handleErrors();
                 return "";
             }
             
-            // 初始化加密操作
-            if (EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv) != 1) {
-                EVP_CIPHER_CTX_free(ctx);
-                handleErrors();
-                return "";
-            }
-            
             // 準備輸出緩衝區
             std::vector<unsigned char> ciphertext(plaintext.length() + BLOCK_SIZE);
             int len = 0;
@@ -212,7 +268,7 @@ public:
             // 加密
             if (EVP_EncryptUpdate(ctx, ciphertext.data(), &len,
                                   (unsigned char*)plaintext.c_str(), plaintext.length()) != 1) {
-                EVP_CIPHER_CTX_free(ctx);
+                cached.keyed = false;
                 handleErrors();
                 return "";
             }
@@ -220,14 +276,12 @@ public:
             
             // 完成加密 (處理 padding)
             if (EVP_EncryptFinal_ex(ctx, ciphertext.data() + len, &len) != 1) {
-                EVP_CIPHER_CTX_free(ctx);
+                cached.keyed = false;
                 handleErrors();
                 return "";
             }
             ciphertext_len += len;
             
-            EVP_CIPHER_CTX_free(ctx);
-            
             // 組合 IV 和密文，然後 Base64 編碼
             std::string ivBase64 = base64_encode(iv, IV_SIZE);
             std::string ciphertextBase64 = base64_encode(ciphertext.data(), ciphertext_len);
@@ -236,7 +290,7 @@ public:
             return ivBase64 + ":" + ciphertextBase64;
             
         } catch (const std::exception& e) {
-            std::cerr << "Crypto encrypt exception: " << e.what() << std::endl;
+            LOG_SAMPLED(LogLevel::Error, 10, "Crypto encrypt exception: " << e.what());
             return "";
         }
     }
@@ -249,7 +303,7 @@ public:
      */
     std::string decrypt(const std::string& encryptedData) {
         if (!keyInitialized) {
-            std::cerr << "Crypto: Key not initialized" << std::endl;
+            LOG_ERROR("Crypto: Key not initialized");
             return "";
         }
         
@@ -257,7 +311,7 @@ public:
             // 分離 IV 和密文
             size_t colonPos = encryptedData.find(':');
             if (colonPos == std::string::npos) {
-                std::cerr << "Crypto: Invalid encrypted data format" << std::endl;
+                LOG_SAMPLED(LogLevel::Error, 10, "Crypto: Invalid encrypted data format");
                 return "";
             }
             
@@ -269,24 +323,18 @@ public:
             std::vector<unsigned char> ciphertext = base64_decode(ciphertextBase64);
             
             if (iv.size() != IV_SIZE) {
-                std::cerr << "Crypto: Invalid IV size" << std::endl;
+                LOG_SAMPLED(LogLevel::Error, 10, "Crypto: Invalid IV size");
                 return "";
             }
             
-            // 準備解密
-            EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+            // 準備解密 (本執行緒快取的 context，只重設 IV)
+            CipherContext& cached = threadContexts().decrypt;
+            EVP_CIPHER_CTX* ctx = prepareContext(cached, false, iv.data());
             if (!ctx) {
                 handleErrors();
                 return "";
             }
             
-            // 初始化解密操作
-            if (EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv.data()) != 1) {
-                EVP_CIPHER_CTX_free(ctx);
-                handleErrors();
-                return "";
-            }
-            
             // 準備輸出緩衝區
             std::vector<unsigned char> plaintext(ciphertext.size() + BLOCK_SIZE);
             int len = 0;
@@ -295,7 +343,7 @@ public:
             // 解密
             if (EVP_DecryptUpdate(ctx, plaintext.data(), &len,
                                   ciphertext.data(), ciphertext.size()) != 1) {
-                EVP_CIPHER_CTX_free(ctx);
+                cached.keyed = false;
                 handleErrors();
                 return "";
             }
@@ -303,18 +351,16 @@ public:
             
             // 完成解密 (處理 padding)
             if (EVP_DecryptFinal_ex(ctx, plaintext.data() + len, &len) != 1) {
-                EVP_CIPHER_CTX_free(ctx);
+                cached.keyed = false;
                 handleErrors();
                 return "";
             }
             plaintext_len += len;
             
-            EVP_CIPHER_CTX_free(ctx);
-            
             return std::string((char*)plaintext.data(), plaintext_len);
             
         } catch (const std::exception& e) {
-            std::cerr << "Crypto decrypt exception: " << e.what() << std::endl;
+            LOG_SAMPLED(LogLevel::Error, 10, "Crypto decrypt exception: " << e.what());
             return "";
         }
     }
@@ -351,38 +397,44 @@ public:
         return decrypt(encryptedData);
     }
     
-    // 測試加密功能
+    // 測試加密功能 (檢查的是 OpenSSL 本身，與金鑰無關：整個行程只實際執行一次，之後回傳同樣結果)
     bool selfTest() {
-        std::cout << "🧪 Running Crypto self-test..." << std::endl;
+        static std::once_flag once;
+        static bool passed = false;
+        std::call_once(once, [this] { passed = runSelfTest(); });
+        return passed;
+    }
+    
+    ~Crypto() {
+        OPENSSL_cleanse(key, KEY_SIZE);
+    }
+
+private:
+    bool runSelfTest() {
+        LOG_INFO("🧪 Running Crypto self-test...");
         
         std::string testMessage = "Hello, this is a test message for encryption!";
         
         // 測試加密
         std::string encrypted = encryptMessage(testMessage);
         if (encrypted.empty()) {
-            std::cerr << "❌ Self-test failed: encryption returned empty" << std::endl;
+            LOG_ERROR("❌ Self-test failed: encryption returned empty");
             return false;
         }
-        std::cout << "   Encrypted: " << encrypted.substr(0, 50) << "..." << std::endl;
+        LOG_DEBUG("   Encrypted: " << encrypted.substr(0, 50) << "...");
         
         // 測試解密
         std::string decrypted = decryptMessage(encrypted);
         if (decrypted != testMessage) {
-            std::cerr << "❌ Self-test failed: decrypted message doesn't match" << std::endl;
-            std::cerr << "   Expected: " << testMessage << std::endl;
-            std::cerr << "   Got: " << decrypted << std::endl;
+            LOG_ERROR("❌ Self-test failed: decrypted message doesn't match");
+            LOG_ERROR("   Expected: " << testMessage);
+            LOG_ERROR("   Got: " << decrypted);
             return false;
         }
         
-        std::cout << "✅ Crypto self-test passed!" << std::endl;
+        LOG_INFO("✅ Crypto self-test passed!");
         return true;
     }
-    
-    ~Crypto() {
-        // 清理 OpenSSL
-        EVP_cleanup();
-        ERR_free_strings();
-    }
 };
 
 // Base64 字元表
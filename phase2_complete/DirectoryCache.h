@@ -0,0 +1,126 @@
+#ifndef DIRECTORY_CACHE_H
+#define DIRECTORY_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Phase 2: 版本化目錄快取 (Versioned Directory Cache)
+ *
+ * LIST / LIST_ROOMS 的回應只在目錄變動後第一次查詢時重建一次，
+ * 之後所有查詢共用同一份序列化好的快照。
+ *
+ * 協議:
+ *   LIST                         -> 完整清單 (舊格式)
+ *   LIST <version> [<after>]     -> NOT_MODIFIED <version>
+ *                                   或 ONLINE_USERS <version> <next|END>: ...
+ *   <after> 為上一頁最後一個名稱，依名稱分頁，版本改變時游標仍然有效
+ */
+class DirectoryCache {
+public:
+    static const size_t PAGE_SIZE = 100;
+
+    struct Entry {
+        std::string key;      // 排序與分頁用的名稱
+        std::string display;  // 序列化後的單筆內容，例如 "alice(127.0.0.1:9001)"
+    };
+
+    struct Snapshot {
+        uint64_t version;
+        std::vector<Entry> entries;  // 依 key 排序
+        std::string fullResponse;    // 舊格式的完整回應
+    };
+
+    // prefix: "ONLINE_USERS" / "ROOMS"，emptyResponse: 沒有資料時的舊格式回應
+    DirectoryCache(std::string prefix, std::string emptyResponse)
+        : prefix(std::move(prefix)), emptyResponse(std::move(emptyResponse)),
+          version(initialVersion()) {}
+
+    // 目錄內容改變時呼叫
+    void invalidate() {
+        version.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    uint64_t currentVersion() const {
+        return version.load(std::memory_order_acquire);
+    }
+
+    // 取得目前版本的快照，必要時用 builder 重建
+    // builder(std::vector<Entry>&) 負責填入目錄內容
+    template <typename Builder>
+    std::shared_ptr<const Snapshot> get(Builder&& builder) {
+        uint64_t v = currentVersion();
+        std::shared_ptr<const Snapshot> snapshot = std::atomic_load(&current);
+        if (snapshot && snapshot->version == v) return snapshot;
+
+        std::lock_guard<std::mutex> lock(build_mutex);
+        v = currentVersion();
+        snapshot = std::atomic_load(&current);
+        if (snapshot && snapshot->version == v) return snapshot;
+
+        auto rebuilt = std::make_shared<Snapshot>();
+        rebuilt->version = v;
+        builder(rebuilt->entries);
+        std::sort(rebuilt->entries.begin(), rebuilt->entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.key < b.key; });
+
+        if (rebuilt->entries.empty()) {
+            rebuilt->fullResponse = emptyResponse;
+        } else {
+            rebuilt->fullResponse = prefix + ":";
+            for (const Entry& entry : rebuilt->entries) {
+                rebuilt->fullResponse += " " + entry.display;
+            }
+        }
+
+        snapshot = rebuilt;
+        std::atomic_store(&current, snapshot);
+        return snapshot;
+    }
+
+    // 版本化查詢：版本相同且沒有游標時回傳 NOT_MODIFIED，否則回傳一頁
+    std::string page(const Snapshot& snapshot, uint64_t knownVersion, std::string_view after) const {
+        if (after.empty() && knownVersion == snapshot.version) {
+            return "NOT_MODIFIED " + std::to_string(snapshot.version);
+        }
+
+        auto begin = snapshot.entries.begin();
+        if (!after.empty()) {
+            begin = std::upper_bound(snapshot.entries.begin(), snapshot.entries.end(), after,
+                [](std::string_view key, const Entry& entry) { return key < entry.key; });
+        }
+        auto end = snapshot.entries.end();
+        if ((size_t)(end - begin) > PAGE_SIZE) {
+            end = begin + PAGE_SIZE;
+        }
+
+        std::string next = (end == snapshot.entries.end()) ? "END" : (end - 1)->key;
+        std::string result = prefix + " " + std::to_string(snapshot.version) + " " + next + ":";
+        for (auto it = begin; it != end; ++it) {
+            result += " " + it->display;
+        }
+        return result;
+    }
+
+private:
+    std::string prefix;
+    std::string emptyResponse;
+    std::atomic<uint64_t> version;
+    std::mutex build_mutex;
+    std::shared_ptr<const Snapshot> current;
+
+    // 以啟動時間為起點，Server 重啟後舊版本號不會誤判為 NOT_MODIFIED
+    static uint64_t initialVersion() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+};
+
+#endif // DIRECTORY_CACHE_H
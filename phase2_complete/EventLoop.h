@@ -0,0 +1,507 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+#include "Protocol.h"
+#include "Logger.h"
+
+/**
+ * Phase 2: 非阻塞事件迴圈 (Reactor)
+ *
+ * - Linux 使用 edge-triggered epoll，macOS 使用 kqueue (EV_CLEAR)
+ * - 少數執行緒即可多工處理大量連線的 accept / read / write
+ * - 以 FrameDecoder 解出完整訊框後才交給上層
+ * - 每條連線有自己的有界輸出佇列，由事件迴圈負責寫出；
+ *   佇列超過高水位時暫停讀取該連線並丟棄推播，慢的接收端只會影響自己
+ * - 佇列存放 SharedFrame，同一則廣播只編碼一次，由所有接收者共用
+ * - 可建立多個 EventLoop，各自持有 SO_REUSEPORT 的 listen socket，
+ *   由 kernel 把新連線分散到各個事件迴圈
+ */
+
+class EventLoop;
+
+class Connection : public std::enable_shared_from_this<Connection> {
+private:
+    int fd;
+    std::string clientIP;
+    int clientId;
+    EventLoop* loop;
+
+    // 輸出佇列：任何執行緒都可以放入訊框，只由事件迴圈寫出 (out_mutex 保護)
+    std::mutex out_mutex;
+    std::deque<SharedFrame> outQueue;
+    size_t frontOffset;         // 第一個訊框已寫出的位元組數
+    size_t queuedBytes;
+    bool closed;
+    bool flushScheduled;        // 已通知事件迴圈寫出
+    bool aboveHighWatermark;
+    bool overflowed;            // 回應累積超過上限，連線將被關閉
+
+    bool enqueue(SharedFrame frame, bool droppable);
+
+public:
+    // 以下欄位只由事件迴圈執行緒存取
+    FrameDecoder decoder;
+    bool readPaused;
+
+    // 上層 (ChatServer) 的每連線狀態，由 inbound_mutex 保護
+    std::mutex inbound_mutex;
+    std::deque<std::string> pendingCommands;
+    bool processing;
+    bool disconnected;
+    std::string currentUser;
+
+    // 輸出佇列水位 (bytes)
+    static size_t getLowWatermark() { return 256 * 1024; }
+    static size_t getHighWatermark() { return 1024 * 1024; }
+    static size_t getMaxQueuedBytes() { return 8 * 1024 * 1024; }
+
+    Connection(int socket, const std::string& ip, int id, EventLoop* owner)
+        : fd(socket), clientIP(ip), clientId(id), loop(owner),
+          frontOffset(0), queuedBytes(0), closed(false), flushScheduled(false),
+          aboveHighWatermark(false), overflowed(false),
+          readPaused(false), processing(false), disconnected(false) {}
+
+    int getFd() const { return fd; }
+    const std::string& getIP() const { return clientIP; }
+    int getId() const { return clientId; }
+
+    // 指令回應：一定要送達，累積超過上限時視為連線異常並關閉
+    bool send(std::string frame) {
+        return enqueue(std::make_shared<const std::string>(std::move(frame)), false);
+    }
+
+    // 推播訊息 (例如群組廣播)：超過高水位時直接丟棄
+    bool push(SharedFrame frame) { return enqueue(std::move(frame), true); }
+
+    /**
+     * 由事件迴圈呼叫：盡量寫出佇列內容 (不會阻塞)
+     * @return false 表示連線應關閉
+     */
+    bool flush() {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        flushScheduled = false;
+        if (closed || overflowed) return false;
+
+        const int MAX_IOV = 64;
+        while (!outQueue.empty()) {
+            // 一次 sendmsg 寫出多個訊框
+            struct iovec iov[MAX_IOV];
+            int count = 0;
+            for (auto it = outQueue.begin(); it != outQueue.end() && count < MAX_IOV; ++it) {
+                size_t skip = (count == 0) ? frontOffset : 0;
+                iov[count].iov_base = (void*)((*it)->data() + skip);
+                iov[count].iov_len = (*it)->size() - skip;
+                ++count;
+            }
+
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+
+            ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return false;
+            }
+
+            // 移除已完整寫出的訊框
+            queuedBytes -= sent;
+            size_t remaining = sent;
+            while (remaining > 0) {
+                size_t frontLeft = outQueue.front()->size() - frontOffset;
+                if (remaining < frontLeft) {
+                    frontOffset += remaining;
+                    break;
+                }
+                remaining -= frontLeft;
+                outQueue.pop_front();
+                frontOffset = 0;
+            }
+        }
+
+        if (aboveHighWatermark && queuedBytes <= getLowWatermark()) {
+            aboveHighWatermark = false;
+        }
+        return true;
+    }
+
+    // 輸出佇列超過高水位 (尚未降到低水位)
+    bool isWriteBlocked() {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        return aboveHighWatermark;
+    }
+
+    size_t getQueuedBytes() {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        return queuedBytes;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        if (closed) return;
+        closed = true;
+        outQueue.clear();
+        queuedBytes = 0;
+        ::close(fd);
+    }
+
+    bool isClosed() {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        return closed;
+    }
+};
+
+class EventLoop {
+public:
+    using ConnectionPtr = std::shared_ptr<Connection>;
+    using OpenCallback = std::function<void(const ConnectionPtr&)>;
+    using MessageCallback = std::function<void(const ConnectionPtr&, std::string&&)>;
+    using CloseCallback = std::function<void(const ConnectionPtr&)>;
+
+private:
+    int pollFd;
+    int listenSocket;
+    int wakeupPipe[2];
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> droppedFrames{0};   // 因接收端太慢而丟棄的推播 (累計)
+    std::atomic<int>* clientCounter;
+
+    // fd -> 連線 (只由事件迴圈執行緒存取)
+    std::map<int, ConnectionPtr> connections;
+
+    // 其他執行緒要求寫出的連線 (pending_mutex 保護)
+    std::mutex pending_mutex;
+    std::vector<ConnectionPtr> pendingFlush;
+    bool wakeupPending;
+
+    OpenCallback onOpen;
+    MessageCallback onMessage;
+    CloseCallback onClose;
+
+    static bool setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0) return false;
+        return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    bool watch(int fd, bool wantWrite) {
+#ifdef __linux__
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+        if (wantWrite) ev.events |= EPOLLOUT;
+        ev.data.fd = fd;
+        return epoll_ctl(pollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+        struct kevent changes[2];
+        int n = 0;
+        EV_SET(&changes[n++], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, NULL);
+        if (wantWrite) {
+            EV_SET(&changes[n++], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, NULL);
+        }
+        return kevent(pollFd, changes, n, NULL, 0, NULL) == 0;
+#endif
+    }
+
+    void handleAccept() {
+        // edge-triggered：一次把 backlog 中的連線全部接完
+        while (true) {
+            struct sockaddr_in clientAddr;
+            socklen_t clientAddrLen = sizeof(clientAddr);
+            int clientSocket = accept(listenSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
+            if (clientSocket < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    LOG_ERROR("Accept failed: " << strerror(errno));
+                }
+                return;
+            }
+
+            if (!setNonBlocking(clientSocket)) {
+                close(clientSocket);
+                continue;
+            }
+            int nodelay = 1;
+            setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+            char ipBuffer[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &clientAddr.sin_addr, ipBuffer, sizeof(ipBuffer));
+            int clientId = ++(*clientCounter);
+
+            auto conn = std::make_shared<Connection>(clientSocket, ipBuffer, clientId, this);
+            if (!watch(clientSocket, true)) {
+                LOG_ERROR("Event registration failed: " << strerror(errno));
+                close(clientSocket);
+                continue;
+            }
+            connections[clientSocket] = conn;
+            if (onOpen) onOpen(conn);
+        }
+    }
+
+    // 讀取所有可讀資料並解出完整訊框，回傳 false 表示連線應關閉
+    bool handleRead(const ConnectionPtr& conn) {
+        char buffer[16384];
+        while (true) {
+            // 輸出佇列塞滿時先不讀取，讓 TCP 流量控制回壓到 client
+            if (conn->isWriteBlocked()) {
+                conn->readPaused = true;
+                return true;
+            }
+            ssize_t bytesReceived = recv(conn->getFd(), buffer, sizeof(buffer), 0);
+            if (bytesReceived > 0) {
+                conn->decoder.feed(buffer, bytesReceived);
+                if (!dispatchFrames(conn)) return false;
+                continue;
+            }
+            if (bytesReceived < 0 && errno == EINTR) continue;
+            if (bytesReceived < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            // 0 = 對方關閉，其他 = 錯誤
+            return false;
+        }
+    }
+
+    bool dispatchFrames(const ConnectionPtr& conn) {
+        std::string payload;
+        while (conn->decoder.next(payload)) {
+            if (onMessage) onMessage(conn, std::move(payload));
+        }
+        if (conn->decoder.hasError()) {
+            LOG_WARN("[Client " << conn->getId() << "] Invalid frame, closing");
+            return false;
+        }
+        return true;
+    }
+
+    // 寫出輸出佇列，佇列降到低水位後恢復讀取
+    void handleWritable(const ConnectionPtr& conn) {
+        if (!conn->flush()) {
+            closeConnection(conn->getFd());
+            return;
+        }
+        if (conn->readPaused && !conn->isWriteBlocked()) {
+            conn->readPaused = false;
+            if (!handleRead(conn)) {
+                closeConnection(conn->getFd());
+            }
+        }
+    }
+
+    void processPendingFlush() {
+        std::vector<ConnectionPtr> batch;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            batch.swap(pendingFlush);
+            wakeupPending = false;
+        }
+        for (const ConnectionPtr& conn : batch) {
+            // 連線可能已關閉 (fd 甚至已被新連線重用)
+            auto it = connections.find(conn->getFd());
+            if (it == connections.end() || it->second != conn) continue;
+            handleWritable(conn);
+        }
+    }
+
+    void wakeup() {
+        if (wakeupPipe[1] >= 0) {
+            char c = 1;
+            ssize_t ignored = write(wakeupPipe[1], &c, 1);
+            (void)ignored;
+        }
+    }
+
+    void closeConnection(int fd) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) return;
+        ConnectionPtr conn = it->second;
+        connections.erase(it);
+        // 先關閉 fd (同時自動從 epoll/kqueue 移除)，再通知上層清理
+        conn->close();
+        if (onClose) onClose(conn);
+    }
+
+public:
+    EventLoop(std::atomic<int>& counter)
+        : pollFd(-1), listenSocket(-1), clientCounter(&counter), wakeupPending(false) {
+        wakeupPipe[0] = wakeupPipe[1] = -1;
+    }
+
+    void setCallbacks(OpenCallback open, MessageCallback message, CloseCallback closed) {
+        onOpen = std::move(open);
+        onMessage = std::move(message);
+        onClose = std::move(closed);
+    }
+
+    // 將已 listen 的 socket 交給事件迴圈
+    bool init(int listenFd) {
+        listenSocket = listenFd;
+#ifdef __linux__
+        pollFd = epoll_create1(0);
+#else
+        pollFd = kqueue();
+#endif
+        if (pollFd < 0) {
+            LOG_ERROR("Event poller creation failed: " << strerror(errno));
+            return false;
+        }
+        if (pipe(wakeupPipe) < 0) {
+            LOG_ERROR("Wakeup pipe creation failed: " << strerror(errno));
+            return false;
+        }
+        setNonBlocking(wakeupPipe[0]);
+        setNonBlocking(listenSocket);
+        return watch(listenSocket, false) && watch(wakeupPipe[0], false);
+    }
+
+    void run() {
+        running = true;
+        const int MAX_EVENTS = 256;
+#ifdef __linux__
+        struct epoll_event events[MAX_EVENTS];
+#else
+        struct kevent events[MAX_EVENTS];
+#endif
+        while (running) {
+#ifdef __linux__
+            int n = epoll_wait(pollFd, events, MAX_EVENTS, -1);
+#else
+            int n = kevent(pollFd, NULL, 0, events, MAX_EVENTS, NULL);
+#endif
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                LOG_ERROR("Event wait failed: " << strerror(errno));
+                break;
+            }
+
+            for (int i = 0; i < n; ++i) {
+#ifdef __linux__
+                int fd = events[i].data.fd;
+                bool readable = events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+                bool writable = events[i].events & EPOLLOUT;
+                bool failed = events[i].events & EPOLLERR;
+#else
+                int fd = (int)events[i].ident;
+                bool readable = events[i].filter == EVFILT_READ;
+                bool writable = events[i].filter == EVFILT_WRITE;
+                bool failed = events[i].flags & EV_ERROR;
+#endif
+                if (fd == wakeupPipe[0]) {
+                    char drain[64];
+                    while (read(wakeupPipe[0], drain, sizeof(drain)) > 0) {}
+                    processPendingFlush();
+                    continue;
+                }
+                if (fd == listenSocket) {
+                    handleAccept();
+                    continue;
+                }
+
+                auto it = connections.find(fd);
+                if (it == connections.end()) continue;
+                ConnectionPtr conn = it->second;
+
+                if (failed) {
+                    closeConnection(fd);
+                    continue;
+                }
+                if (writable) {
+                    handleWritable(conn);
+                    if (conn->isClosed()) continue;
+                }
+                if (readable && !handleRead(conn)) {
+                    closeConnection(fd);
+                }
+            }
+        }
+
+        // 結束時關閉所有連線
+        while (!connections.empty()) {
+            closeConnection(connections.begin()->first);
+        }
+    }
+
+    void stop() {
+        running = false;
+        wakeup();
+    }
+
+    // 任何執行緒都可呼叫：請事件迴圈寫出該連線的輸出佇列
+    void requestFlush(ConnectionPtr conn) {
+        bool needWakeup = false;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            pendingFlush.push_back(std::move(conn));
+            if (!wakeupPending) {
+                wakeupPending = true;
+                needWakeup = true;
+            }
+        }
+        if (needWakeup) wakeup();
+    }
+
+    size_t getConnectionCount() const { return connections.size(); }
+
+    // 本事件迴圈所有連線丟棄的推播數 (累計，任何執行緒可讀)
+    uint64_t getDroppedFrames() const { return droppedFrames.load(std::memory_order_relaxed); }
+    void countDroppedFrame() { droppedFrames.fetch_add(1, std::memory_order_relaxed); }
+    
+    ~EventLoop() {
+        if (pollFd >= 0) close(pollFd);
+        if (wakeupPipe[0] >= 0) close(wakeupPipe[0]);
+        if (wakeupPipe[1] >= 0) close(wakeupPipe[1]);
+    }
+};
+
+inline bool Connection::enqueue(SharedFrame frame, bool droppable) {
+    bool needFlush = false;
+    {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        if (closed || overflowed) return false;
+
+        if (droppable && aboveHighWatermark) {
+            loop->countDroppedFrame();
+            return false;
+        }
+
+        queuedBytes += frame->size();
+        outQueue.push_back(std::move(frame));
+        if (queuedBytes >= getHighWatermark()) aboveHighWatermark = true;
+        // 回應仍持續累積：client 不讀取資料，由事件迴圈關閉連線
+        if (queuedBytes > getMaxQueuedBytes()) overflowed = true;
+
+        if (!flushScheduled) {
+            flushScheduled = true;
+            needFlush = true;
+        }
+    }
+    if (needFlush) loop->requestFlush(shared_from_this());
+    return true;
+}
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,452 @@
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+#if defined(__APPLE__) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 600   // macOS 的 ucontext 需要
+#endif
+#include <ucontext.h>
+#include "Logger.h"
+#include "Task.h"
+#include "SocketIO.h"
+
+/**
+ * Phase 2: Stackful Fiber (M:N 排程)
+ *
+ * - 每個 fiber 有自己的堆疊 (mmap，低位址留一頁保護頁)，以 ucontext 切換，
+ *   在少數 carrier 執行緒上輪流執行，原本「一條連線一個執行緒」的阻塞式處理函式不必改寫
+ * - SocketIO::recv/send 在 fiber 內遇到 EAGAIN 時把 socket 交給 poller (epoll/kqueue，
+ *   EPOLLONESHOT/EV_ONESHOT) 並讓出 carrier，可讀/可寫後再排回執行佇列；
+ *   在 fiber 外呼叫時就是一般的阻塞式 recv/send
+ * - 讓出時不能持有 mutex (fiber 恢復時可能在另一個 carrier 上)；
+ *   thread_local 也不保證跨過讓出點仍是同一份；同一個 fd 同時只能有一個 fiber 在等待
+ * - shutdown()：不再接受新 fiber，等待中的 I/O 以 ECANCELED 失敗返回，
+ *   等所有 fiber 自然結束後才停止 carrier
+ */
+class FiberScheduler {
+public:
+    static const size_t DEFAULT_STACK_SIZE = 256 * 1024;
+
+    explicit FiberScheduler(size_t carriers = defaultCarriers(), size_t stackSize = DEFAULT_STACK_SIZE);
+    ~FiberScheduler() { shutdown(); }
+
+    FiberScheduler(const FiberScheduler&) = delete;
+    FiberScheduler& operator=(const FiberScheduler&) = delete;
+
+    // 建立 fiber；shutdown 之後 (或堆疊配置失敗) 回傳 false
+    template<class F>
+    bool spawn(F&& f) {
+        Fiber* fiber = createFiber();
+        if (fiber == nullptr) return false;
+        fiber->entry.emplace(std::forward<F>(f));
+        std::unique_lock<std::mutex> lock(run_mutex);
+        if (stopping) {
+            lock.unlock();
+            destroyFiber(fiber);
+            return false;
+        }
+        ++liveFibers;
+        runQueue.push_back(fiber);
+        runnable.notify_one();
+        return true;
+    }
+
+    void shutdown();
+
+    size_t getCarrierCount() const { return carriers.size(); }
+    size_t getFiberCount() const {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        return liveFibers;
+    }
+
+    static size_t defaultCarriers() {
+        return std::min<size_t>(4, std::max(1u, std::thread::hardware_concurrency() / 4));
+    }
+
+    // 目前是否在 fiber 內執行
+    static bool inFiber() { return currentFiber() != nullptr; }
+
+    // 讓其他 fiber 先執行 (fiber 外呼叫等同 std::this_thread::yield)
+    static void yield();
+
+    // 等待 fd 可讀/可寫；fiber 外直接回傳 true (由呼叫端照常阻塞)
+    // 回傳 false 表示無法等待 (scheduler 正在關閉，或 fd 不能交給 poller)，errno 說明原因
+    static bool waitReadable(int fd) { return waitFd(fd, false); }
+    static bool waitWritable(int fd) { return waitFd(fd, true); }
+
+private:
+    enum class Park { None, Yield, WaitIo, Finished };
+
+    struct Fiber {
+        ucontext_t context;
+        ucontext_t* carrier = nullptr;   // 目前執行它的 carrier，切回去用
+        FiberScheduler* owner = nullptr;
+        void* stack = nullptr;
+        Task entry;
+        Park park = Park::None;
+        int waitFd = -1;
+        bool waitWrite = false;
+        int waitError = 0;               // 0 = fd 就緒；否則等待失敗的 errno
+    };
+
+    static const size_t STACK_CACHE_LIMIT = 64;
+
+    size_t stackSize;
+    size_t pageSize;
+    std::vector<std::thread> carriers;
+    std::thread poller;
+
+    // 執行佇列 (run_mutex 保護)
+    mutable std::mutex run_mutex;
+    std::condition_variable runnable;
+    std::deque<Fiber*> runQueue;
+    size_t liveFibers = 0;
+    bool stopping = false;
+    bool stopped = false;
+    std::vector<void*> stackCache;
+
+    // 等待 I/O 中的 fiber (poll_mutex 保護；登記/取消 poller 也在鎖內，避免與喚醒互相競爭)
+    std::mutex poll_mutex;
+    std::unordered_set<Fiber*> parked;
+    bool canceling = false;
+    int pollFd = -1;
+    int wakeupPipe[2] = {-1, -1};
+
+    // 不可 inline：fiber 可能在另一個 carrier 上恢復，每次都要重新取得 thread_local 的位址
+    __attribute__((noinline)) static Fiber*& currentSlot() {
+        thread_local Fiber* current = nullptr;
+        return current;
+    }
+    __attribute__((noinline)) static Fiber* currentFiber() { return currentSlot(); }
+
+    // 不可 inline：恢復後的 errno 要在新的 carrier 上重新取得位址
+    __attribute__((noinline)) static bool waitFd(int fd, bool write) {
+        Fiber* fiber = currentFiber();
+        if (fiber == nullptr) return true;
+        fiber->waitFd = fd;
+        fiber->waitWrite = write;
+        fiber->waitError = 0;
+        switchToCarrier(fiber, Park::WaitIo);
+        if (fiber->waitError != 0) {
+            errno = fiber->waitError;
+            return false;
+        }
+        return true;
+    }
+    static void trampoline();
+    static void switchToCarrier(Fiber* fiber, Park park);
+
+    Fiber* createFiber();
+    void destroyFiber(Fiber* fiber);
+    void enqueue(Fiber* fiber);
+    void carrierLoop();
+    void parkFiber(Fiber* fiber);
+    void pollerLoop();
+    void cancelParked();
+};
+
+inline FiberScheduler::FiberScheduler(size_t carrierCount, size_t stack)
+    : stackSize(stack), pageSize((size_t)sysconf(_SC_PAGESIZE)) {
+    stackSize = (std::max<size_t>(stackSize, 64 * 1024) + pageSize - 1) / pageSize * pageSize;
+    carrierCount = std::max<size_t>(carrierCount, 1);
+
+    // SocketIO 在 fiber 內改為讓出 carrier 等待 socket
+    static const SocketIO::Waiter waiter{&FiberScheduler::inFiber, &FiberScheduler::waitFd};
+    SocketIO::installWaiter(&waiter);
+
+#ifdef __linux__
+    pollFd = epoll_create1(0);
+#else
+    pollFd = kqueue();
+#endif
+    if (pollFd < 0 || pipe(wakeupPipe) < 0) {
+        throw std::runtime_error(std::string("FiberScheduler: poller creation failed: ") + strerror(errno));
+    }
+    fcntl(wakeupPipe[0], F_SETFL, fcntl(wakeupPipe[0], F_GETFL, 0) | O_NONBLOCK);
+#ifdef __linux__
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(pollFd, EPOLL_CTL_ADD, wakeupPipe[0], &ev);
+#else
+    struct kevent change;
+    EV_SET(&change, wakeupPipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+    kevent(pollFd, &change, 1, NULL, 0, NULL);
+#endif
+
+    LOG_INFO("FiberScheduler started with " << carrierCount << " carrier threads ("
+             << stackSize / 1024 << "KB stacks)");
+    poller = std::thread([this] { pollerLoop(); });
+    for (size_t i = 0; i < carrierCount; ++i) {
+        carriers.emplace_back([this] { carrierLoop(); });
+    }
+}
+
+inline void FiberScheduler::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        if (stopped) return;
+        stopped = true;
+        stopping = true;
+    }
+    // poller 取消所有等待中的 fiber 後結束；之後再等待的 fiber 會立即失敗
+    char signal = 1;
+    while (write(wakeupPipe[1], &signal, 1) < 0 && errno == EINTR) {}
+    poller.join();
+    runnable.notify_all();
+    for (std::thread& carrier : carriers) {
+        carrier.join();
+    }
+    for (void* stack : stackCache) {
+        munmap(stack, stackSize + pageSize);
+    }
+    stackCache.clear();
+    close(pollFd);
+    close(wakeupPipe[0]);
+    close(wakeupPipe[1]);
+}
+
+inline FiberScheduler::Fiber* FiberScheduler::createFiber() {
+    void* stack = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        if (stopping) return nullptr;
+        if (!stackCache.empty()) {
+            stack = stackCache.back();
+            stackCache.pop_back();
+        }
+    }
+    if (stack == nullptr) {
+        stack = mmap(nullptr, stackSize + pageSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (stack == MAP_FAILED) {
+            LOG_ERROR("FiberScheduler: stack allocation failed: " << strerror(errno));
+            return nullptr;
+        }
+        mprotect(stack, pageSize, PROT_NONE);   // 堆疊往低位址成長，溢位時撞到保護頁
+    }
+
+    Fiber* fiber = new Fiber();
+    fiber->owner = this;
+    fiber->stack = stack;
+    getcontext(&fiber->context);
+    fiber->context.uc_stack.ss_sp = (char*)stack + pageSize;
+    fiber->context.uc_stack.ss_size = stackSize;
+    fiber->context.uc_link = nullptr;
+    makecontext(&fiber->context, &FiberScheduler::trampoline, 0);
+    return fiber;
+}
+
+inline void FiberScheduler::destroyFiber(Fiber* fiber) {
+    void* stack = fiber->stack;
+    delete fiber;
+    {
+        std::lock_guard<std::mutex> lock(run_mutex);
+        if (stackCache.size() < STACK_CACHE_LIMIT) {
+            stackCache.push_back(stack);
+            return;
+        }
+    }
+    munmap(stack, stackSize + pageSize);
+}
+
+inline void FiberScheduler::enqueue(Fiber* fiber) {
+    std::lock_guard<std::mutex> lock(run_mutex);
+    runQueue.push_back(fiber);
+    runnable.notify_one();
+}
+
+inline void FiberScheduler::trampoline() {
+    Fiber* fiber = currentFiber();
+    try {
+        fiber->entry();
+    } catch (const std::exception& e) {
+        LOG_ERROR("Fiber exception: " << e.what());
+    } catch (...) {
+        LOG_ERROR("Fiber unknown exception");
+    }
+    fiber->entry.reset();
+    switchToCarrier(fiber, Park::Finished);
+}
+
+// 切回 carrier；由 carrier 在離開 fiber 的堆疊之後才處理 park (排回佇列/交給 poller/回收)
+inline void FiberScheduler::switchToCarrier(Fiber* fiber, Park park) {
+    fiber->park = park;
+    swapcontext(&fiber->context, fiber->carrier);
+}
+
+inline void FiberScheduler::yield() {
+    Fiber* fiber = currentFiber();
+    if (fiber == nullptr) {
+        std::this_thread::yield();
+        return;
+    }
+    switchToCarrier(fiber, Park::Yield);
+}
+
+inline void FiberScheduler::carrierLoop() {
+    for (;;) {
+        Fiber* fiber;
+        {
+            std::unique_lock<std::mutex> lock(run_mutex);
+            runnable.wait(lock, [this] { return !runQueue.empty() || (stopping && liveFibers == 0); });
+            if (runQueue.empty()) break;
+            fiber = runQueue.front();
+            runQueue.pop_front();
+        }
+
+        ucontext_t self;
+        fiber->carrier = &self;
+        fiber->park = Park::None;
+        currentSlot() = fiber;
+        swapcontext(&self, &fiber->context);
+        currentSlot() = nullptr;
+
+        switch (fiber->park) {
+        case Park::Yield:
+            enqueue(fiber);
+            break;
+        case Park::WaitIo:
+            parkFiber(fiber);
+            break;
+        case Park::Finished:
+        case Park::None: {
+            destroyFiber(fiber);
+            std::lock_guard<std::mutex> lock(run_mutex);
+            if (--liveFibers == 0 && stopping) runnable.notify_all();
+            break;
+        }
+        }
+    }
+}
+
+inline void FiberScheduler::parkFiber(Fiber* fiber) {
+    std::unique_lock<std::mutex> lock(poll_mutex);
+    int error = ECANCELED;
+    if (!canceling) {
+#ifdef __linux__
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLONESHOT | (fiber->waitWrite ? EPOLLOUT : (EPOLLIN | EPOLLRDHUP));
+        ev.data.ptr = fiber;
+        bool added = epoll_ctl(pollFd, EPOLL_CTL_ADD, fiber->waitFd, &ev) == 0;
+#else
+        struct kevent change;
+        EV_SET(&change, fiber->waitFd, fiber->waitWrite ? EVFILT_WRITE : EVFILT_READ,
+               EV_ADD | EV_ONESHOT, 0, 0, fiber);
+        bool added = kevent(pollFd, &change, 1, NULL, 0, NULL) == 0;
+#endif
+        if (added) {
+            parked.insert(fiber);
+            return;
+        }
+        error = errno;
+    }
+    lock.unlock();
+    fiber->waitError = error;
+    enqueue(fiber);
+}
+
+inline void FiberScheduler::pollerLoop() {
+    const int MAX_EVENTS = 256;
+#ifdef __linux__
+    struct epoll_event events[MAX_EVENTS];
+#else
+    struct kevent events[MAX_EVENTS];
+#endif
+    for (;;) {
+#ifdef __linux__
+        int n = epoll_wait(pollFd, events, MAX_EVENTS, -1);
+#else
+        int n = kevent(pollFd, NULL, 0, events, MAX_EVENTS, NULL);
+#endif
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("FiberScheduler: event wait failed: " << strerror(errno));
+            break;
+        }
+
+        bool wakeup = false;
+        std::vector<Fiber*> ready;
+        {
+            std::lock_guard<std::mutex> lock(poll_mutex);
+            for (int i = 0; i < n; ++i) {
+#ifdef __linux__
+                Fiber* fiber = static_cast<Fiber*>(events[i].data.ptr);
+#else
+                Fiber* fiber = static_cast<Fiber*>(events[i].udata);
+#endif
+                if (fiber == nullptr) {
+                    wakeup = true;
+                    continue;
+                }
+                if (parked.erase(fiber) == 0) continue;
+#ifdef __linux__
+                epoll_ctl(pollFd, EPOLL_CTL_DEL, fiber->waitFd, nullptr);
+#endif
+                ready.push_back(fiber);
+            }
+        }
+        for (Fiber* fiber : ready) {
+            enqueue(fiber);
+        }
+
+        if (wakeup) {
+            char drain[64];
+            while (read(wakeupPipe[0], drain, sizeof(drain)) > 0) {}
+            std::lock_guard<std::mutex> lock(run_mutex);
+            if (stopping) break;
+        }
+    }
+    cancelParked();
+}
+
+inline void FiberScheduler::cancelParked() {
+    std::vector<Fiber*> canceled;
+    {
+        std::lock_guard<std::mutex> lock(poll_mutex);
+        canceling = true;
+        for (Fiber* fiber : parked) {
+#ifdef __linux__
+            epoll_ctl(pollFd, EPOLL_CTL_DEL, fiber->waitFd, nullptr);
+#else
+            struct kevent change;
+            EV_SET(&change, fiber->waitFd, fiber->waitWrite ? EVFILT_WRITE : EVFILT_READ,
+                   EV_DELETE, 0, 0, NULL);
+            kevent(pollFd, &change, 1, NULL, 0, NULL);
+#endif
+            fiber->waitError = ECANCELED;
+            canceled.push_back(fiber);
+        }
+        parked.clear();
+    }
+    for (Fiber* fiber : canceled) {
+        enqueue(fiber);
+    }
+}
+
+#endif // FIBER_H
@@ -12,6 +12,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include "Crypto.h"
+#include "Protocol.h"
 
 /**
  * Phase 2: File Transfer Module
@@ -52,42 +53,12 @@ private:
     
     // 發送帶長度前綴的數據
     bool sendWithLength(int socket, const std::string& data) {
-        uint32_t len = htonl(data.length());
-        if (send(socket, &len, sizeof(len), 0) != sizeof(len)) {
-            return false;
-        }
-        
-        size_t totalSent = 0;
-        while (totalSent < data.length()) {
-            ssize_t sent = send(socket, data.c_str() + totalSent, 
-                               data.length() - totalSent, 0);
-            if (sent <= 0) return false;
-            totalSent += sent;
-        }
-        return true;
+        return Protocol::sendFrame(socket, data);
     }
     
     // 接收帶長度前綴的數據
     bool recvWithLength(int socket, std::string& data) {
-        uint32_t len;
-        if (recv(socket, &len, sizeof(len), MSG_WAITALL) != sizeof(len)) {
-            return false;
-        }
-        len = ntohl(len);
-        
-        if (len > 100 * 1024 * 1024) { // 限制 100MB
-            std::cerr << "FileTransfer: Data too large: " << len << std::endl;
-            return false;
-        }
-        
-        data.resize(len);
-        size_t totalRecv = 0;
-        while (totalRecv < len) {
-            ssize_t received = recv(socket, &data[totalRecv], len - totalRecv, 0);
-            if (received <= 0) return false;
-            totalRecv += received;
-        }
-        return true;
+        return Protocol::recvFrame(socket, data, Protocol::getMaxTransferFrameSize());
     }
 
 public:
@@ -112,7 +83,7 @@ public:
         // 檢查檔案是否存在
         std::ifstream file(filepath, std::ios::binary);
         if (!file.is_open()) {
-            std::cerr << "❌ Cannot open file: " << filepath << std::endl;
+            LOG_ERROR("❌ Cannot open file: " << filepath);
             return false;
         }
         
@@ -125,7 +96,7 @@ public:
         // 建立連接
         int targetSocket = socket(AF_INET, SOCK_STREAM, 0);
         if (targetSocket < 0) {
-            std::cerr << "❌ Failed to create socket" << std::endl;
+            LOG_ERROR("❌ Failed to create socket");
             return false;
         }
         
@@ -134,13 +105,13 @@ public:
         targetAddr.sin_port = htons(targetPort);
         
         if (inet_pton(AF_INET, targetIP.c_str(), &targetAddr.sin_addr) <= 0) {
-            std::cerr << "❌ Invalid IP address" << std::endl;
+            LOG_ERROR("❌ Invalid IP address");
             close(targetSocket);
             return false;
         }
         
         if (connect(targetSocket, (struct sockaddr*)&targetAddr, sizeof(targetAddr)) < 0) {
-            std::cerr << "❌ Failed to connect to " << targetIP << ":" << targetPort << std::endl;
+            LOG_ERROR("❌ Failed to connect to " << targetIP << ":" << targetPort);
             close(targetSocket);
             return false;
         }
@@ -155,7 +126,7 @@ public:
                                 (encryptionEnabled ? "1" : "0");
             
             if (!sendWithLength(targetSocket, header)) {
-                std::cerr << "❌ Failed to send header" << std::endl;
+                LOG_ERROR("❌ Failed to send header");
                 close(targetSocket);
                 return false;
             }
@@ -163,13 +134,13 @@ public:
             // 等待確認
             std::string response;
             if (!recvWithLength(targetSocket, response)) {
-                std::cerr << "❌ Failed to receive response" << std::endl;
+                LOG_ERROR("❌ Failed to receive response");
                 close(targetSocket);
                 return false;
             }
             
             if (response != "FILE_ACCEPT") {
-                std::cerr << "❌ Transfer rejected: " << response << std::endl;
+                LOG_ERROR("❌ Transfer rejected: " << response);
                 close(targetSocket);
                 return false;
             }
@@ -187,15 +158,15 @@ public:
                 
                 if (actualRead == 0) {
                     // 修改這裡，印出更多除錯資訊
-                    std::cerr << "❌ Failed to read file." << std::endl;
-                    std::cerr << "   Desired read: " << toRead << " bytes" << std::endl;
-                    std::cerr << "   Stream state (good/eof/fail/bad): " 
+                    LOG_ERROR("❌ Failed to read file.");
+                    LOG_ERROR("   Desired read: " << toRead << " bytes");
+                    LOG_ERROR("   Stream state (good/eof/fail/bad): " 
                             << file.good() << "/" << file.eof() << "/" 
-                            << file.fail() << "/" << file.bad() << std::endl;
+                            << file.fail() << "/" << file.bad());
                     
                     // 如果是 Unix 系統，可以印出系統錯誤碼
                     if (file.fail()) {
-                        std::cerr << "   System Error: " << strerror(errno) << std::endl;
+                        LOG_ERROR("   System Error: " << strerror(errno));
                     }
                     
                     close(targetSocket);
@@ -208,7 +179,7 @@ public:
                 if (encryptionEnabled) {
                     std::string encrypted = crypto.encrypt(chunkData);
                     if (encrypted.empty()) {
-                        std::cerr << "❌ Encryption failed" << std::endl;
+                        LOG_ERROR("❌ Encryption failed");
                         close(targetSocket);
                         return false;
                     }
@@ -217,7 +188,7 @@ public:
                 
                 // 發送 chunk
                 if (!sendWithLength(targetSocket, chunkData)) {
-                    std::cerr << "❌ Failed to send chunk " << chunkNum << std::endl;
+                    LOG_ERROR("❌ Failed to send chunk " << chunkNum);
                     close(targetSocket);
                     return false;
                 }
@@ -235,7 +206,7 @@ public:
             
             // 等待完成確認
             if (!recvWithLength(targetSocket, response)) {
-                std::cerr << "❌ Failed to receive completion" << std::endl;
+                LOG_ERROR("❌ Failed to receive completion");
                 close(targetSocket);
                 return false;
             }
@@ -248,13 +219,13 @@ public:
                 close(targetSocket);
                 return true;
             } else {
-                std::cerr << "❌ Transfer failed: " << response << std::endl;
+                LOG_ERROR("❌ Transfer failed: " << response);
                 close(targetSocket);
                 return false;
             }
             
         } catch (const std::exception& e) {
-            std::cerr << "❌ Exception: " << e.what() << std::endl;
+            LOG_ERROR("❌ Exception: " << e.what());
             close(targetSocket);
             return false;
         }
@@ -266,6 +237,8 @@ public:
     /**
      * 處理檔案接收
      * 
+     * 在 fiber 內執行時，等待 socket 的期間會讓出 carrier (Protocol 使用 SocketIO)
+     * 
      * @param clientSocket 客戶端 socket
      * @param header 已接收的 header
      * @param savePath 儲存路徑
@@ -282,7 +255,7 @@ public:
             
             if (pos1 == std::string::npos || pos2 == std::string::npos || 
                 pos3 == std::string::npos) {
-                std::cerr << "❌ Invalid file transfer header" << std::endl;
+                LOG_ERROR("❌ Invalid file transfer header");
                 sendWithLength(clientSocket, "FILE_REJECT:Invalid header");
                 return false;
             }
@@ -300,7 +273,7 @@ public:
             
             // 發送接受確認
             if (!sendWithLength(clientSocket, "FILE_ACCEPT")) {
-                std::cerr << "❌ Failed to send accept" << std::endl;
+                LOG_ERROR("❌ Failed to send accept");
                 return false;
             }
             
@@ -308,7 +281,7 @@ public:
             std::string fullPath = savePath + "/" + filename;
             std::ofstream outFile(fullPath, std::ios::binary);
             if (!outFile.is_open()) {
-                std::cerr << "❌ Cannot create file: " << fullPath << std::endl;
+                LOG_ERROR("❌ Cannot create file: " << fullPath);
                 return false;
             }
             
@@ -318,7 +291,7 @@ public:
             while (totalReceived < fileSize) {
                 std::string chunkData;
                 if (!recvWithLength(clientSocket, chunkData)) {
-                    std::cerr << "❌ Failed to receive chunk" << std::endl;
+                    LOG_ERROR("❌ Failed to receive chunk");
                     outFile.close();
                     return false;
                 }
@@ -328,7 +301,7 @@ public:
                 if (isEncrypted) {
                     decryptedData = crypto.decrypt(chunkData);
                     if (decryptedData.empty()) {
-                        std::cerr << "❌ Decryption failed" << std::endl;
+                        LOG_ERROR("❌ Decryption failed");
                         outFile.close();
                         return false;
                     }
@@ -351,7 +324,7 @@ public:
             
             // 發送完成確認
             if (!sendWithLength(clientSocket, "FILE_COMPLETE")) {
-                std::cerr << "❌ Failed to send completion" << std::endl;
+                LOG_ERROR("❌ Failed to send completion");
                 return false;
             }
             
@@ -363,7 +336,7 @@ public:
             return true;
             
         } catch (const std::exception& e) {
-            std::cerr << "❌ Exception: " << e.what() << std::endl;
+            LOG_ERROR("❌ Exception: " << e.what());
             return false;
         }
     }
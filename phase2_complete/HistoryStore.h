@@ -0,0 +1,535 @@
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Logger.h"
+#include "CommandParser.h"
+
+/**
+ * Phase 2: 持久化群組歷史 (Memory-mapped Segment Log)
+ *
+ * 每個房間一個目錄，訊息依序附加到 segment 檔：
+ *   <dir>/<room>/<第一則的序號>.seg
+ *
+ * - 寫入：segment 預先配置空間並 mmap，附加一則訊息只是 memcpy；
+ *   新 segment 從 INITIAL_SEGMENT_BYTES 開始，寫滿時加倍重新配置，直到 segmentBytes
+ * - 讀取：ROOM_HISTORY 直接讀映射的記憶體，熱頁面不需要 read() 系統呼叫
+ * - 稀疏索引：每 INDEX_INTERVAL 則記錄一次 (序號, 偏移)，查詢時二分搜尋再往後掃
+ * - segment 寫滿後封存 (截掉未用空間、改為唯讀映射)，超過保留數量時刪除最舊的
+ * - 重啟時掃描 segment 重建索引，序號接續上次；序號不連續時，缺口之前的 segment
+ *   改名為 .seg.quarantined 留在磁碟上，不再載入
+ *
+ * 記錄格式 (主機位元組順序):
+ *   [u32 記錄總長][u64 seq][u16 sender 長度][sender][text]
+ * 總長欄位最後寫入，寫到一半中斷時該欄為 0，重啟掃描到此為止。
+ * 不做 msync：行程崩潰不會遺失資料 (已在 page cache)，主機斷電則可能遺失最後幾頁。
+ *
+ * 非執行緒安全，由 ChatRoom::room_mutex 保護。
+ */
+class SegmentLog {
+public:
+    static const size_t HEADER_SIZE = 14;
+    static const size_t INDEX_INTERVAL = 64;
+    static constexpr size_t INITIAL_SEGMENT_BYTES = 4096;
+
+    ~SegmentLog() {
+        for (Segment& segment : segments) {
+            unmap(segment);
+        }
+    }
+
+    SegmentLog(const SegmentLog&) = delete;
+    SegmentLog& operator=(const SegmentLog&) = delete;
+
+    // 開啟 (必要時建立) 房間目錄並重建索引，失敗時回傳 nullptr
+    static std::unique_ptr<SegmentLog> open(const std::string& directory, size_t segmentBytes, size_t maxSegments) {
+        if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG_ERROR("⚠️ History: cannot create " << directory << ": " << strerror(errno));
+            return nullptr;
+        }
+        std::unique_ptr<SegmentLog> log(new SegmentLog(directory, segmentBytes, maxSegments));
+        if (!log->recover()) return nullptr;
+        return log;
+    }
+
+    // 附加訊息並回傳序號，寫入失敗時回傳 0
+    uint64_t append(std::string_view sender, std::string_view text) {
+        if (sender.size() > UINT16_MAX) return 0;
+        size_t recordSize = HEADER_SIZE + sender.size() + text.size();
+        if (recordSize > UINT32_MAX) return 0;
+
+        if (segments.empty() || !segments.back().writable ||
+            segments.back().used + recordSize > segments.back().capacity) {
+            if (segments.empty() || !segments.back().writable || !grow(segments.back(), recordSize)) {
+                if (!roll(recordSize)) return 0;
+            }
+        }
+
+        Segment& segment = segments.back();
+        char* record = segment.data + segment.used;
+        uint64_t seq = nextSeq;
+        uint16_t senderLength = (uint16_t)sender.size();
+        uint32_t length = (uint32_t)recordSize;
+        memcpy(record + 4, &seq, sizeof(seq));
+        memcpy(record + 12, &senderLength, sizeof(senderLength));
+        memcpy(record + HEADER_SIZE, sender.data(), sender.size());
+        memcpy(record + HEADER_SIZE + sender.size(), text.data(), text.size());
+        memcpy(record, &length, sizeof(length));  // 最後寫入長度，記錄才算完整
+
+        if (segment.count % INDEX_INTERVAL == 0) {
+            segment.index.push_back(IndexEntry{seq, segment.used});
+        }
+        segment.used += recordSize;
+        ++segment.count;
+        return nextSeq++;
+    }
+
+    // 與 RoomHistory::pageBefore 相同：由舊到新走訪 seq < beforeSeq 的最後 limit 則
+    // fn(seq, sender, text) 收到的 string_view 指向映射記憶體，只在持有 room_mutex 期間有效
+    template <typename F>
+    void pageBefore(uint64_t beforeSeq, size_t limit, F&& fn) const {
+        uint64_t end = (beforeSeq == 0 || beforeSeq > nextSeq) ? nextSeq : beforeSeq;
+        uint64_t oldest = oldestSeq();
+        if (end <= oldest || limit == 0) return;
+        uint64_t start = (end - oldest > limit) ? end - limit : oldest;
+
+        // 找到包含 start 的 segment
+        auto it = std::upper_bound(segments.begin(), segments.end(), start,
+            [](uint64_t seq, const Segment& segment) { return seq < segment.baseSeq; });
+        size_t segmentIndex = (size_t)(it - segments.begin()) - 1;
+        size_t offset = locate(segments[segmentIndex], start);
+
+        for (uint64_t seq = start; seq < end;) {
+            const Segment& segment = segments[segmentIndex];
+            if (seq >= segment.baseSeq + segment.count) {
+                ++segmentIndex;
+                offset = 0;
+                continue;
+            }
+            Record record = readRecord(segment, offset);
+            fn(seq, record.sender, record.text);
+            offset += record.length;
+            ++seq;
+        }
+    }
+
+    bool empty() const { return oldestSeq() == nextSeq; }
+    uint64_t oldestSeq() const { return segments.empty() ? nextSeq : segments.front().baseSeq; }
+    uint64_t latestSeq() const { return nextSeq - 1; }
+    size_t segmentCount() const { return segments.size(); }
+
+private:
+    struct IndexEntry {
+        uint64_t seq;
+        size_t offset;
+    };
+
+    struct Segment {
+        uint64_t baseSeq = 0;
+        uint64_t count = 0;
+        std::string path;
+        char* data = nullptr;
+        size_t capacity = 0;  // 映射大小
+        size_t used = 0;      // 已寫入的位元組
+        bool writable = false;
+        std::vector<IndexEntry> index;  // 稀疏索引，依 seq 排序
+    };
+
+    struct Record {
+        uint32_t length;
+        uint64_t seq;
+        std::string_view sender;
+        std::string_view text;
+    };
+
+    std::string directory;
+    size_t segmentBytes;
+    size_t maxSegments;
+    std::vector<Segment> segments;  // 依 baseSeq 排序，最後一個可寫
+    uint64_t nextSeq;
+
+    SegmentLog(const std::string& dir, size_t bytes, size_t maxCount)
+        : directory(dir), segmentBytes(std::max<size_t>(bytes, 4096)),
+          maxSegments(std::max<size_t>(maxCount, 1)), nextSeq(1) {}
+
+    std::string segmentPath(uint64_t baseSeq) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%020llu.seg", (unsigned long long)baseSeq);
+        return directory + "/" + name;
+    }
+
+    static Record readRecord(const Segment& segment, size_t offset) {
+        const char* p = segment.data + offset;
+        Record record;
+        uint16_t senderLength;
+        memcpy(&record.length, p, sizeof(record.length));
+        memcpy(&record.seq, p + 4, sizeof(record.seq));
+        memcpy(&senderLength, p + 12, sizeof(senderLength));
+        record.sender = std::string_view(p + HEADER_SIZE, senderLength);
+        record.text = std::string_view(p + HEADER_SIZE + senderLength,
+                                       record.length - HEADER_SIZE - senderLength);
+        return record;
+    }
+
+    // 記錄是否完整可讀 (重啟掃描用)
+    static bool validRecord(const Segment& segment, size_t offset, uint64_t expectedSeq) {
+        if (offset + HEADER_SIZE > segment.used) return false;
+        uint32_t length;
+        uint64_t seq;
+        uint16_t senderLength;
+        memcpy(&length, segment.data + offset, sizeof(length));
+        memcpy(&seq, segment.data + offset + 4, sizeof(seq));
+        memcpy(&senderLength, segment.data + offset + 12, sizeof(senderLength));
+        return length >= HEADER_SIZE + senderLength && offset + length <= segment.used &&
+               seq == expectedSeq;
+    }
+
+    // 稀疏索引找到不大於 seq 的最近位置，再往後掃到該記錄
+    static size_t locate(const Segment& segment, uint64_t seq) {
+        auto it = std::upper_bound(segment.index.begin(), segment.index.end(), seq,
+            [](uint64_t target, const IndexEntry& entry) { return target < entry.seq; });
+        size_t offset = 0;
+        uint64_t current = segment.baseSeq;
+        if (it != segment.index.begin()) {
+            --it;
+            offset = it->offset;
+            current = it->seq;
+        }
+        while (current < seq) {
+            uint32_t length;
+            memcpy(&length, segment.data + offset, sizeof(length));
+            offset += length;
+            ++current;
+        }
+        return offset;
+    }
+
+    static char* mapFile(const std::string& path, size_t size, bool writable) {
+        if (size == 0) return nullptr;
+        int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (fd < 0) return nullptr;
+        void* addr = mmap(nullptr, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);  // 映射建立後不再需要 fd，避免房間多時耗盡檔案描述符
+        return addr == MAP_FAILED ? nullptr : (char*)addr;
+    }
+
+    static void unmap(Segment& segment) {
+        if (segment.data != nullptr) {
+            munmap(segment.data, segment.capacity);
+            segment.data = nullptr;
+        }
+    }
+
+    // 掃描既有 segment，最後一個重新以可寫方式映射繼續附加
+    bool recover() {
+        std::vector<uint64_t> bases;
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr) {
+            LOG_ERROR("⚠️ History: cannot open " << directory << ": " << strerror(errno));
+            return false;
+        }
+        while (dirent* entry = readdir(dir)) {
+            std::string_view name(entry->d_name);
+            uint64_t base = 0;
+            if (name.size() > 4 && name.substr(name.size() - 4) == ".seg" &&
+                CommandParser::parseInt(name.substr(0, name.size() - 4), base) && base > 0) {
+                bases.push_back(base);
+            }
+        }
+        closedir(dir);
+        std::sort(bases.begin(), bases.end());
+
+        for (size_t i = 0; i < bases.size(); ++i) {
+            Segment segment;
+            segment.baseSeq = bases[i];
+            segment.path = segmentPath(bases[i]);
+            bool last = (i + 1 == bases.size());
+
+            struct stat st;
+            if (stat(segment.path.c_str(), &st) != 0) continue;
+            segment.capacity = (size_t)st.st_size;
+            segment.used = segment.capacity;
+            segment.writable = last;
+            segment.data = mapFile(segment.path, segment.capacity, last);
+            if (segment.data == nullptr && segment.capacity > 0) {
+                LOG_ERROR("⚠️ History: cannot map " << segment.path);
+                continue;
+            }
+
+            size_t offset = 0;
+            uint64_t seq = segment.baseSeq;
+            while (validRecord(segment, offset, seq)) {
+                if (segment.count % INDEX_INTERVAL == 0) {
+                    segment.index.push_back(IndexEntry{seq, offset});
+                }
+                uint32_t length;
+                memcpy(&length, segment.data + offset, sizeof(length));
+                offset += length;
+                ++segment.count;
+                ++seq;
+            }
+            segment.used = offset;
+
+            // 序號必須接續前一個 segment，不連續時停在缺口：較舊的部分隔離保存，不刪除
+            if (!segments.empty() && segment.baseSeq != nextSeq) {
+                LOG_WARN("⚠️ History: sequence gap in " << directory << " at seq " << nextSeq
+                         << ", quarantining " << segments.size() << " older segment(s)");
+                for (Segment& older : segments) quarantine(older);
+                segments.clear();
+            }
+
+            if (segment.count == 0 && !last) {
+                if (segment.capacity == 0) {
+                    ::unlink(segment.path.c_str());  // 空檔案
+                } else {
+                    LOG_WARN("⚠️ History: no readable record in " << segment.path);
+                    quarantine(segment);
+                }
+                unmap(segment);
+                continue;
+            }
+
+            // 中斷寫入留下的殘缺記錄清成 0，之後從這裡繼續附加
+            if (last && segment.data != nullptr && segment.used < segment.capacity) {
+                memset(segment.data + segment.used, 0,
+                       std::min(segment.capacity - segment.used, HEADER_SIZE + (size_t)UINT16_MAX));
+            }
+
+            nextSeq = segment.baseSeq + segment.count;
+            segments.push_back(std::move(segment));
+        }
+
+        while (segments.size() > maxSegments) retireOldest();
+        return true;
+    }
+
+    // 封存目前的 segment 並建立新的 (容量至少放得下這筆記錄)
+    bool roll(size_t recordSize) {
+        if (!segments.empty() && segments.back().writable) {
+            Segment& active = segments.back();
+            if (active.count == 0) {
+                // 空的 segment 放不下這筆記錄，直接換成更大的
+                unmap(active);
+                ::unlink(active.path.c_str());
+                segments.pop_back();
+            } else if (!seal(active)) {
+                // 封存後讀不到的 segment 會讓序號出現缺口，連同更舊的一起淘汰
+                while (!segments.empty()) retireOldest();
+            }
+        }
+
+        Segment segment;
+        segment.baseSeq = nextSeq;
+        segment.path = segmentPath(nextSeq);
+        // 先配置小容量，之後由 grow 加倍，少量訊息的房間不會佔用整個 segmentBytes
+        segment.capacity = std::max(std::min(segmentBytes, INITIAL_SEGMENT_BYTES), recordSize);
+        segment.writable = true;
+
+        int fd = ::open(segment.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            LOG_ERROR("⚠️ History: cannot create " << segment.path << ": " << strerror(errno));
+            return false;
+        }
+        int err = allocate(fd, segment.capacity);
+        ::close(fd);
+        if (err != 0) {
+            LOG_ERROR("⚠️ History: cannot allocate " << segment.path << ": " << strerror(err));
+            ::unlink(segment.path.c_str());
+            return false;
+        }
+        segment.data = mapFile(segment.path, segment.capacity, true);
+        if (segment.data == nullptr) {
+            LOG_ERROR("⚠️ History: cannot map " << segment.path);
+            ::unlink(segment.path.c_str());
+            return false;
+        }
+
+        segments.push_back(std::move(segment));
+        while (segments.size() > maxSegments) retireOldest();
+        return true;
+    }
+
+    // 預先配置磁碟空間，避免寫入映射時因空間不足收到 SIGBUS
+    static int allocate(int fd, size_t size) {
+#ifdef __linux__
+        return posix_fallocate(fd, 0, (off_t)size);
+#else
+        return ftruncate(fd, (off_t)size) == 0 ? 0 : errno;
+#endif
+    }
+
+    // 可寫 segment 容量加倍 (最多 segmentBytes) 以放入 recordSize，已達上限或失敗時回傳 false 改為 roll
+    bool grow(Segment& segment, size_t recordSize) {
+        size_t needed = segment.used + recordSize;
+        if (needed > segmentBytes) return false;
+        size_t capacity = std::max<size_t>(segment.capacity, INITIAL_SEGMENT_BYTES);
+        while (capacity < needed) capacity *= 2;
+        capacity = std::min(capacity, segmentBytes);
+
+        int fd = ::open(segment.path.c_str(), O_RDWR);
+        if (fd < 0) return false;
+        int err = allocate(fd, capacity);
+        ::close(fd);
+        if (err != 0) {
+            LOG_WARN("⚠️ History: cannot grow " << segment.path << ": " << strerror(err));
+            return false;
+        }
+        // 先建立新映射再放掉舊的，失敗時原本的映射仍可用
+        char* data = mapFile(segment.path, capacity, true);
+        if (data == nullptr) return false;
+        unmap(segment);
+        segment.data = data;
+        segment.capacity = capacity;
+        return true;
+    }
+
+    // 截掉未使用的預配置空間，改為唯讀映射
+    bool seal(Segment& segment) {
+        unmap(segment);
+        segment.writable = false;
+        if (::truncate(segment.path.c_str(), (off_t)segment.used) != 0) {
+            LOG_WARN("⚠️ History: cannot truncate " << segment.path << ": " << strerror(errno));
+        }
+        segment.capacity = segment.used;
+        segment.data = mapFile(segment.path, segment.capacity, false);
+        if (segment.data == nullptr && segment.capacity > 0) {
+            LOG_ERROR("⚠️ History: cannot remap " << segment.path);
+            return false;
+        }
+        return true;
+    }
+
+    // 讀不到的 segment 改名留在磁碟上 (不再符合 *.seg，重啟時不會載入)
+    static void quarantine(Segment& segment) {
+        unmap(segment);
+        std::string target = segment.path + ".quarantined";
+        if (::rename(segment.path.c_str(), target.c_str()) != 0) {
+            LOG_ERROR("⚠️ History: cannot quarantine " << segment.path << ": " << strerror(errno));
+        } else {
+            LOG_WARN("⚠️ History: kept " << segment.path << " as " << target);
+        }
+    }
+
+    void retireOldest() {
+        Segment& oldest = segments.front();
+        unmap(oldest);
+        ::unlink(oldest.path.c_str());
+        segments.erase(segments.begin());
+    }
+};
+
+/**
+ * 持久化歷史的根目錄與參數 (CHAT_HISTORY_DIR / CHAT_HISTORY_SEGMENT_BYTES / CHAT_HISTORY_SEGMENTS)
+ */
+class HistoryStore {
+public:
+    HistoryStore(std::string dir, size_t segmentBytes, size_t maxSegments)
+        : root(std::move(dir)), segmentBytes(segmentBytes), maxSegments(maxSegments) {
+        if (root.empty()) return;
+        if (::mkdir(root.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG_ERROR("⚠️ History: cannot create " << root << ": " << strerror(errno)
+                      << ", room history is memory-only");
+            root.clear();
+        }
+    }
+
+    bool enabled() const { return !root.empty(); }
+    const std::string& directory() const { return root; }
+
+    // 開啟房間的 segment log，未啟用或失敗時回傳 nullptr (呼叫端改用記憶體歷史)
+    // 房間與成員不會保存，目錄記錄建立者：同一個建立者重建房間時接續之前的歷史，
+    // 換成其他人取得這個名稱時，舊目錄改名封存，新房間從空的歷史開始
+    std::unique_ptr<SegmentLog> openRoom(const std::string& roomName, const std::string& creator) const {
+        if (!enabled()) return nullptr;
+        std::string directory = root + "/" + encodeName(roomName);
+        std::string ownerPath = directory + "/" + OWNER_FILE;
+        std::string owner = readFile(ownerPath);
+        struct stat st;
+        if (owner != creator && ::stat(directory.c_str(), &st) == 0 && !archive(directory)) {
+            return nullptr;
+        }
+        std::unique_ptr<SegmentLog> log = SegmentLog::open(directory, segmentBytes, maxSegments);
+        if (log && owner != creator && !writeOwner(ownerPath, creator)) return nullptr;
+        return log;
+    }
+
+private:
+    static constexpr const char* OWNER_FILE = "owner";
+
+    std::string root;
+    size_t segmentBytes;
+    size_t maxSegments;
+
+    static std::string readFile(const std::string& path) {
+        std::string content;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return content;
+        char buffer[256];
+        ssize_t n;
+        while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            content.append(buffer, (size_t)n);
+        }
+        ::close(fd);
+        return content;
+    }
+
+    // 先寫 .tmp 再 rename，不會留下寫一半的建立者
+    static bool writeOwner(const std::string& path, const std::string& creator) {
+        std::string tmpPath = path + ".tmp";
+        int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool ok = fd >= 0 && ::write(fd, creator.data(), creator.size()) == (ssize_t)creator.size();
+        if (fd >= 0) ::close(fd);
+        if (!ok || ::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            LOG_ERROR("⚠️ History: cannot write " << path << ": " << strerror(errno));
+            ::unlink(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // 舊目錄改名為 <room>.archived-<時間>；'.' 在 encodeName 中會被轉碼，不會和房間目錄撞名
+    static bool archive(const std::string& directory) {
+        std::string base = directory + ".archived-" + std::to_string((long long)time(nullptr));
+        std::string target = base;
+        for (int attempt = 1; ::rename(directory.c_str(), target.c_str()) != 0; ++attempt) {
+            if ((errno != EEXIST && errno != ENOTEMPTY) || attempt > 100) {
+                LOG_ERROR("⚠️ History: cannot archive " << directory << ": " << strerror(errno));
+                return false;
+            }
+            target = base + "-" + std::to_string(attempt);
+        }
+        LOG_WARN("⚠️ History: " << directory << " belonged to another owner, archived as " << target);
+        return true;
+    }
+
+    // 房間名稱轉成安全的目錄名：英數字、'-'、'_' 保留，其餘轉成 %XX
+    static std::string encodeName(const std::string& name) {
+        static const char hex[] = "0123456789ABCDEF";
+        std::string encoded;
+        for (unsigned char c : name) {
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_') {
+                encoded += (char)c;
+            } else {
+                encoded += '%';
+                encoded += hex[c >> 4];
+                encoded += hex[c & 0xF];
+            }
+        }
+        return encoded;
+    }
+};
+
+#endif // HISTORY_STORE_H
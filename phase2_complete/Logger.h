@@ -0,0 +1,332 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+/**
+ * Phase 2: 非同步日誌 (Asynchronous Logger)
+ *
+ * - 每個執行緒有自己的 ring buffer (單一寫入者/單一讀取者，無鎖)
+ * - 背景 flusher 執行緒批次寫出，呼叫端不會碰到 stdout 的鎖或 flush
+ * - 執行期可調整等級 (環境變數 CHAT_LOG_LEVEL 或 Logger::setLevel)
+ * - LOG_SAMPLED 對每則訊息都會觸發的事件做每秒限量取樣
+ *
+ * 用法:
+ *   LOG_INFO("[Client " << id << "] Connected");
+ *   LOG_SAMPLED(LogLevel::Info, 20, "Received: [" << msg << "]");
+ */
+
+enum class LogLevel : int {
+    Debug = 0,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+// 單一執行緒的日誌緩衝 (SPSC ring buffer)
+class LogRing {
+public:
+    static const size_t CAPACITY = 4096;  // 必須是 2 的次方
+
+    struct Entry {
+        uint64_t sequence;
+        LogLevel level;
+        std::string text;
+    };
+
+    LogRing() : slots(CAPACITY), head(0), tail(0), dropped(0), abandoned(false) {}
+
+    // 寫入端 (擁有此 ring 的執行緒)，滿了就丟棄並計數
+    bool push(uint64_t sequence, LogLevel level, std::string&& text) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) >= CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        Entry& entry = slots[t & (CAPACITY - 1)];
+        entry.sequence = sequence;
+        entry.level = level;
+        entry.text = std::move(text);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 讀取端 (flusher)
+    void drainTo(std::vector<Entry>& out) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        for (; h != t; ++h) {
+            out.push_back(std::move(slots[h & (CAPACITY - 1)]));
+        }
+        head.store(h, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    uint64_t takeDropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+
+    void abandon() { abandoned.store(true, std::memory_order_release); }
+    bool isAbandoned() const { return abandoned.load(std::memory_order_acquire); }
+
+private:
+    std::vector<Entry> slots;
+    std::atomic<size_t> head;  // 下一個要讀的位置
+    std::atomic<size_t> tail;  // 下一個要寫的位置
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> abandoned;  // 擁有者執行緒已結束
+};
+
+// 每秒限量取樣器 (每個 LOG_SAMPLED 呼叫點一個)
+class LogSampler {
+public:
+    explicit LogSampler(uint32_t perSecond) : limit(perSecond), windowStart(0), count(0), suppressed(0) {}
+
+    // 允許輸出時回傳 true，並帶回上一次輸出後被略過的筆數
+    bool allow(uint64_t& suppressedOut) {
+        int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t window = windowStart.load(std::memory_order_relaxed);
+        if (now != window && windowStart.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        if (count.fetch_add(1, std::memory_order_relaxed) >= limit) {
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressedOut = suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    uint32_t limit;
+    std::atomic<int64_t> windowStart;
+    std::atomic<uint32_t> count;
+    std::atomic<uint64_t> suppressed;
+};
+
+class Logger {
+public:
+    static Logger& instance() {
+        // 刻意不解構：其他靜態物件解構時仍可能寫日誌，結束時由 atexit 收尾
+        static Logger* logger = new Logger();
+        return *logger;
+    }
+
+    static bool isEnabled(LogLevel level) {
+        return (int)level >= currentLevel().load(std::memory_order_relaxed);
+    }
+
+    static void setLevel(LogLevel level) {
+        currentLevel().store((int)level, std::memory_order_relaxed);
+    }
+
+    static LogLevel getLevel() {
+        return (LogLevel)currentLevel().load(std::memory_order_relaxed);
+    }
+
+    // "debug" / "info" / "warn" / "error" / "off"
+    static bool parseLevel(const std::string& name, LogLevel& level) {
+        std::string lower(name);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        if (lower == "debug") level = LogLevel::Debug;
+        else if (lower == "info") level = LogLevel::Info;
+        else if (lower == "warn" || lower == "warning") level = LogLevel::Warn;
+        else if (lower == "error") level = LogLevel::Error;
+        else if (lower == "off") level = LogLevel::Off;
+        else return false;
+        return true;
+    }
+
+    // 每個執行緒共用一個格式化用的 stream，避免每筆日誌都建立新的
+    static std::ostringstream& threadStream() {
+        thread_local std::ostringstream stream;
+        return stream;
+    }
+
+    // 取出 stream 內容交給 flusher
+    void commit(LogLevel level, std::ostringstream& stream) {
+        std::string text = stream.str();
+        stream.str(std::string());
+        write(level, std::move(text));
+    }
+
+    void write(LogLevel level, std::string&& text) {
+        uint64_t sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+        if (stopped.load(std::memory_order_acquire)) {
+            // 已經結束 (atexit 之後)：直接同步寫出
+            writeLine(level, text);
+            return;
+        }
+        localRing().push(sequence, level, std::move(text));
+        if (level >= LogLevel::Warn) {
+            wakeup.notify_one();
+        }
+    }
+
+    // 同步寫出目前所有緩衝的日誌
+    void flush() {
+        std::lock_guard<std::mutex> lock(flush_mutex);
+        drainAll();
+    }
+
+private:
+    std::mutex rings_mutex;  // 只在執行緒第一次寫日誌及 flusher 收集時使用
+    std::vector<std::shared_ptr<LogRing>> rings;
+    std::mutex flush_mutex;
+    std::mutex wakeup_mutex;
+    std::condition_variable wakeup;
+    std::atomic<bool> stopped;
+    std::atomic<uint64_t> nextSequence;
+    std::vector<LogRing::Entry> batch;
+    std::thread flusher;
+
+    static std::atomic<int>& currentLevel() {
+        static std::atomic<int> level(initialLevel());
+        return level;
+    }
+
+    static int initialLevel() {
+        LogLevel level = LogLevel::Info;
+        const char* env = std::getenv("CHAT_LOG_LEVEL");
+        if (env != nullptr) {
+            parseLevel(env, level);
+        }
+        return (int)level;
+    }
+
+    // 執行緒結束時標記自己的 ring，flusher 清空後移除
+    struct RingHolder {
+        std::shared_ptr<LogRing> ring;
+        ~RingHolder() {
+            if (ring) ring->abandon();
+        }
+    };
+
+    LogRing& localRing() {
+        thread_local RingHolder holder;
+        if (!holder.ring) {
+            holder.ring = std::make_shared<LogRing>();
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            rings.push_back(holder.ring);
+        }
+        return *holder.ring;
+    }
+
+    Logger() : stopped(false), nextSequence(0) {
+        flusher = std::thread([this]() { flushLoop(); });
+        std::atexit([]() { Logger::instance().shutdown(); });
+    }
+
+    void flushLoop() {
+        while (!stopped.load(std::memory_order_acquire)) {
+            {
+                std::unique_lock<std::mutex> lock(wakeup_mutex);
+                wakeup.wait_for(lock, std::chrono::milliseconds(10));
+            }
+            flush();
+        }
+    }
+
+    void shutdown() {
+        stopped.store(true, std::memory_order_release);
+        wakeup.notify_one();
+        if (flusher.joinable()) {
+            flusher.join();
+        }
+        flush();
+    }
+
+    // 需持有 flush_mutex
+    void drainAll() {
+        uint64_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            for (auto& ring : rings) {
+                ring->drainTo(batch);
+                dropped += ring->takeDropped();
+            }
+            rings.erase(std::remove_if(rings.begin(), rings.end(),
+                [](const std::shared_ptr<LogRing>& ring) {
+                    return ring->isAbandoned() && ring->empty();
+                }), rings.end());
+        }
+        if (batch.empty() && dropped == 0) return;
+
+        // 依寫入順序輸出，一個批次各只寫一次 stdout/stderr
+        std::sort(batch.begin(), batch.end(),
+            [](const LogRing::Entry& a, const LogRing::Entry& b) { return a.sequence < b.sequence; });
+
+        std::string out, err;
+        for (const auto& entry : batch) {
+            std::string& target = entry.level >= LogLevel::Warn ? err : out;
+            target += entry.text;
+            target += '\n';
+        }
+        if (dropped > 0) {
+            err += "⚠️ Logger: " + std::to_string(dropped) + " log lines dropped (buffer full)\n";
+        }
+        batch.clear();
+
+        if (!out.empty()) {
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+        }
+        if (!err.empty()) {
+            fwrite(err.data(), 1, err.size(), stderr);
+            fflush(stderr);
+        }
+    }
+
+    static void writeLine(LogLevel level, const std::string& text) {
+        FILE* stream = level >= LogLevel::Warn ? stderr : stdout;
+        fwrite(text.data(), 1, text.size(), stream);
+        fputc('\n', stream);
+        fflush(stream);
+    }
+};
+
+#define LOG_AT(level, expr) \
+    do { \
+        if (Logger::isEnabled(level)) { \
+            std::ostringstream& log_stream_ = Logger::threadStream(); \
+            log_stream_ << expr; \
+            Logger::instance().commit(level, log_stream_); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(expr) LOG_AT(LogLevel::Debug, expr)
+#define LOG_INFO(expr)  LOG_AT(LogLevel::Info, expr)
+#define LOG_WARN(expr)  LOG_AT(LogLevel::Warn, expr)
+#define LOG_ERROR(expr) LOG_AT(LogLevel::Error, expr)
+
+// 每個呼叫點每秒最多輸出 perSecond 筆，被略過的筆數附在下一筆後面
+#define LOG_SAMPLED(level, perSecond, expr) \
+    do { \
+        if (Logger::isEnabled(level)) { \
+            static LogSampler log_sampler_(perSecond); \
+            uint64_t log_suppressed_ = 0; \
+            if (log_sampler_.allow(log_suppressed_)) { \
+                std::ostringstream& log_stream_ = Logger::threadStream(); \
+                log_stream_ << expr; \
+                if (log_suppressed_ > 0) log_stream_ << " (+" << log_suppressed_ << " suppressed)"; \
+                Logger::instance().commit(level, log_stream_); \
+            } \
+        } \
+    } while (0)
+
+#endif // LOGGER_H
@@ -12,7 +12,9 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include "Crypto.h"
+#include "Protocol.h"
 #include "FileTransfer.h"
+#include "Fiber.h"
 
 /**
  * Phase 2: P2P Client with Encryption and File Transfer Support
@@ -22,6 +24,8 @@
  * - P2P 監聽接收
  * - AES-256-CBC 加密/解密
  * - P2P 檔案傳輸
+ * - 每個 incoming 連線是一個 fiber (Fiber.h)，等待 socket 時讓出 carrier，
+ *   不再一條連線佔用一個執行緒
  */
 
 class P2PClient {
@@ -40,56 +44,30 @@ private:
     // Phase 2: 檔案傳輸模組
     FileTransfer fileTransfer;
     std::string downloadPath;
+
+    // incoming 連線的 fiber (最後宣告、最先解構：處理中的連線會在 crypto/fileTransfer 之前結束)
+    FiberScheduler fibers;
     
     // 發送帶長度前綴的數據
     bool sendWithLength(int socket, const std::string& data) {
-        uint32_t len = htonl(data.length());
-        if (send(socket, &len, sizeof(len), 0) != sizeof(len)) {
-            return false;
-        }
-        
-        size_t totalSent = 0;
-        while (totalSent < data.length()) {
-            ssize_t sent = send(socket, data.c_str() + totalSent, 
-                               data.length() - totalSent, 0);
-            if (sent <= 0) return false;
-            totalSent += sent;
-        }
-        return true;
+        return Protocol::sendFrame(socket, data);
     }
     
     // 接收帶長度前綴的數據
     bool recvWithLength(int socket, std::string& data) {
-        uint32_t len;
-        if (recv(socket, &len, sizeof(len), MSG_WAITALL) != sizeof(len)) {
-            return false;
-        }
-        len = ntohl(len);
-        
-        if (len > 100 * 1024 * 1024) { // 限制 100MB
-            return false;
-        }
-        
-        data.resize(len);
-        size_t totalRecv = 0;
-        while (totalRecv < len) {
-            ssize_t received = recv(socket, &data[totalRecv], len - totalRecv, 0);
-            if (received <= 0) return false;
-            totalRecv += received;
-        }
-        return true;
+        return Protocol::recvFrame(socket, data, Protocol::getMaxTransferFrameSize());
     }
     
 public:
     P2PClient(int port, const std::string& username) 
         : listenPort(port), myUsername(username), encryptionEnabled(true),
-          fileTransfer(crypto), downloadPath(".") {
+          fileTransfer(crypto), downloadPath("."), fibers(2) {
         
         // 執行加密自我測試
         if (crypto.selfTest()) {
-            std::cout << "🔐 P2P Encryption enabled (AES-256-CBC)" << std::endl;
+            LOG_INFO("🔐 P2P Encryption enabled (AES-256-CBC)");
         } else {
-            std::cerr << "⚠️ Encryption self-test failed, disabling encryption" << std::endl;
+            LOG_WARN("⚠️ Encryption self-test failed, disabling encryption");
             encryptionEnabled = false;
         }
         
@@ -99,14 +77,14 @@ public:
     // 設定下載路徑
     void setDownloadPath(const std::string& path) {
         downloadPath = path;
-        std::cout << "📁 Download path set to: " << downloadPath << std::endl;
+        LOG_INFO("📁 Download path set to: " << downloadPath);
     }
     
     // 啟用/停用加密
     void setEncryption(bool enabled) {
         encryptionEnabled = enabled;
         fileTransfer.setEncryption(enabled);
-        std::cout << "🔐 P2P Encryption " << (enabled ? "enabled" : "disabled") << std::endl;
+        LOG_INFO("🔐 P2P Encryption " << (enabled ? "enabled" : "disabled"));
     }
     
     bool isEncryptionEnabled() const {
@@ -119,14 +97,14 @@ public:
             // 建立監聽socket
             listenSocket = socket(AF_INET, SOCK_STREAM, 0);
             if (listenSocket < 0) {
-                std::cerr << "P2P: Failed to create listen socket" << std::endl;
+                LOG_ERROR("P2P: Failed to create listen socket");
                 return false;
             }
             
             // 設定socket選項
             int opt = 1;
             if (setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-                std::cerr << "P2P: setsockopt failed" << std::endl;
+                LOG_ERROR("P2P: setsockopt failed");
                 return false;
             }
             
@@ -137,13 +115,13 @@ public:
             addr.sin_port = htons(listenPort);
             
             if (::bind(listenSocket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-                std::cerr << "P2P: Failed to bind to port " << listenPort << std::endl;
+                LOG_ERROR("P2P: Failed to bind to port " << listenPort);
                 return false;
             }
             
             // 開始監聽
             if (listen(listenSocket, 5) < 0) {
-                std::cerr << "P2P: Failed to listen" << std::endl;
+                LOG_ERROR("P2P: Failed to listen");
                 return false;
             }
             
@@ -154,21 +132,21 @@ public:
                 this->listenForP2PConnections();
             });
             
-            std::cout << "✅ P2P Listener started on port " << listenPort << std::endl;
+            LOG_INFO("✅ P2P Listener started on port " << listenPort);
             if (encryptionEnabled) {
-                std::cout << "🔒 All P2P messages and files will be encrypted" << std::endl;
+                LOG_INFO("🔒 All P2P messages and files will be encrypted");
             }
             return true;
             
         } catch (const std::exception& e) {
-            std::cerr << "P2P: Exception in startP2PListener: " << e.what() << std::endl;
+            LOG_ERROR("P2P: Exception in startP2PListener: " << e.what());
             return false;
         }
     }
     
     // 監聽P2P連接
     void listenForP2PConnections() {
-        std::cout << "P2P: Listening thread started (ID: " << std::this_thread::get_id() << ")" << std::endl;
+        LOG_DEBUG("P2P: Listening thread started (ID: " << std::this_thread::get_id() << ")");
         
         while (isListening) {
             struct sockaddr_in clientAddr;
@@ -177,20 +155,22 @@ public:
             int clientSocket = accept(listenSocket, (struct sockaddr*)&clientAddr, &clientLen);
             if (clientSocket < 0) {
                 if (isListening) {
-                    std::cerr << "P2P: Accept failed" << std::endl;
+                    LOG_ERROR("P2P: Accept failed");
                 }
                 continue;
             }
             
             std::string clientIP = inet_ntoa(clientAddr.sin_addr);
             
-            // 處理P2P連接（在新thread中）
-            std::thread([this, clientSocket, clientIP]() {
-                this->handleP2PConnection(clientSocket, clientIP);
-            }).detach();
+            // 處理P2P連接（在新fiber中）
+            if (!fibers.spawn([this, clientSocket, clientIP]() {
+                    this->handleP2PConnection(clientSocket, clientIP);
+                })) {
+                close(clientSocket);
+            }
         }
         
-        std::cout << "P2P: Listening thread finished" << std::endl;
+        LOG_DEBUG("P2P: Listening thread finished");
     }
     
     // 處理incoming P2P連接
@@ -202,7 +182,7 @@ public:
                 // 嘗試舊協議（向後兼容）
                 char buffer[4096];
                 memset(buffer, 0, sizeof(buffer));
-                int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+                int bytesReceived = SocketIO::recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
                 if (bytesReceived <= 0) {
                     close(clientSocket);
                     return;
@@ -213,7 +193,7 @@ public:
             
             // 檢查是否為檔案傳輸請求
             if (FileTransfer::isFileTransferRequest(message)) {
-                std::cout << "📨 File transfer request from: " << clientIP << std::endl;
+                LOG_INFO("📨 File transfer request from: " << clientIP);
                 fileTransfer.handleFileReceive(clientSocket, message, downloadPath);
                 close(clientSocket);
                 return;
@@ -242,15 +222,18 @@ public:
                         displayContent = content;
                     }
                     
-                    std::lock_guard<std::mutex> lock(p2p_mutex);
-                    std::cout << std::endl;
-                    if (wasEncrypted) {
-                        std::cout << "🔓💬 [P2P-Encrypted] " << sender << ": " << displayContent << std::endl;
-                    } else {
-                        std::cout << "💬 [P2P] " << sender << ": " << displayContent << std::endl;
+                    {
+                        // fiber 讓出前要先放開 lock (送出確認可能會等待)
+                        std::lock_guard<std::mutex> lock(p2p_mutex);
+                        std::cout << std::endl;
+                        if (wasEncrypted) {
+                            std::cout << "🔓💬 [P2P-Encrypted] " << sender << ": " << displayContent << std::endl;
+                        } else {
+                            std::cout << "💬 [P2P] " << sender << ": " << displayContent << std::endl;
+                        }
+                        std::cout << "Press Enter to continue...";
+                        std::cout.flush();
                     }
-                    std::cout << "Press Enter to continue...";
-                    std::cout.flush();
                     
                     // 發送確認
                     std::string ack = "P2P_ACK:" + myUsername;
@@ -259,7 +242,7 @@ public:
             }
             
         } catch (const std::exception& e) {
-            std::cerr << "P2P: Exception handling connection: " << e.what() << std::endl;
+            LOG_ERROR("P2P: Exception handling connection: " << e.what());
         }
         
         close(clientSocket);
@@ -277,7 +260,7 @@ public:
             // 建立到目標的socket連接
             int targetSocket = socket(AF_INET, SOCK_STREAM, 0);
             if (targetSocket < 0) {
-                std::cerr << "P2P: Failed to create socket for sending" << std::endl;
+                LOG_ERROR("P2P: Failed to create socket for sending");
                 return false;
             }
             
@@ -287,13 +270,13 @@ public:
             targetAddr.sin_port = htons(targetPort);
             
             if (inet_pton(AF_INET, targetIP.c_str(), &targetAddr.sin_addr) <= 0) {
-                std::cerr << "P2P: Invalid target IP address" << std::endl;
+                LOG_ERROR("P2P: Invalid target IP address");
                 close(targetSocket);
                 return false;
             }
             
             if (connect(targetSocket, (struct sockaddr*)&targetAddr, sizeof(targetAddr)) < 0) {
-                std::cerr << "P2P: Failed to connect to target" << std::endl;
+                LOG_ERROR("P2P: Failed to connect to target");
                 close(targetSocket);
                 return false;
             }
@@ -304,11 +287,11 @@ public:
                 // 加密訊息內容
                 std::string encryptedContent = crypto.encryptMessage(message);
                 if (encryptedContent.empty()) {
-                    std::cerr << "P2P: Encryption failed, sending unencrypted" << std::endl;
+                    LOG_ERROR("P2P: Encryption failed, sending unencrypted");
                     p2pMessage = "P2P_MSG:" + myUsername + ":" + message;
                 } else {
                     p2pMessage = "P2P_MSG:" + myUsername + ":" + encryptedContent;
-                    std::cout << "🔒 Message encrypted successfully" << std::endl;
+                    LOG_DEBUG("🔒 Message encrypted successfully");
                 }
             } else {
                 // 未加密訊息
@@ -317,7 +300,7 @@ public:
             
             // 發送訊息（使用長度前綴）
             if (!sendWithLength(targetSocket, p2pMessage)) {
-                std::cerr << "P2P: Failed to send message" << std::endl;
+                LOG_ERROR("P2P: Failed to send message");
                 close(targetSocket);
                 return false;
             }
@@ -338,7 +321,7 @@ public:
             return true;
             
         } catch (const std::exception& e) {
-            std::cerr << "P2P: Exception in sendP2PMessage: " << e.what() << std::endl;
+            LOG_ERROR("P2P: Exception in sendP2PMessage: " << e.what());
             return false;
         }
     }
@@ -351,7 +334,7 @@ public:
     // 停止P2P監聽
     void stopP2PListener() {
         if (isListening) {
-            std::cout << "🛑 Stopping P2P listener..." << std::endl;
+            LOG_INFO("🛑 Stopping P2P listener...");
             isListening = false;
             
             if (listenSocket >= 0) {
@@ -362,7 +345,7 @@ public:
                 listenThread.join();
             }
             
-            std::cout << "✅ P2P listener stopped" << std::endl;
+            LOG_INFO("✅ P2P listener stopped");
         }
     }
     
@@ -0,0 +1,264 @@
+#ifndef PASSWORD_POOL_H
+#define PASSWORD_POOL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include "Logger.h"
+
+/**
+ * Phase 2: 密碼雜湊池 (Password Hashing Pool)
+ *
+ * - 密碼以 scrypt (memory-hard KDF) 雜湊後儲存，格式:
+ *     $scrypt$ln=<log2 N>,r=<r>,p=<p>$<salt hex>$<hash hex>
+ * - 一次雜湊/驗證需要數十毫秒與 16MB 記憶體，因此在獨立的固定大小執行緒池執行，
+ *   不佔用處理指令的 ThreadPool，大量登入時訊息轉送不會被餓死
+ * - 佇列有上限，滿了直接拒絕 (呼叫端回覆忙碌)，記憶體用量 = 執行緒數 x 16MB
+ * - 完成時在池內執行緒呼叫 callback，callback 應盡快把後續工作交回 ThreadPool
+ * - 舊資料 (未雜湊的明文密碼) 仍可驗證，verify 會回報 legacy 讓呼叫端升級
+ */
+class PasswordPool {
+public:
+    static const unsigned DEFAULT_LOG_N = 14;  // N = 16384, r = 8 -> 16MB
+    static const size_t SALT_BYTES = 16;
+    static const size_t HASH_BYTES = 32;
+
+    struct Stats {
+        size_t threads;
+        size_t queued;
+        uint64_t submitted;
+        uint64_t completed;
+        uint64_t rejected;
+        uint64_t totalWaitMicros;   // 佇列等待時間總和
+        uint64_t totalWorkMicros;   // KDF 計算時間總和
+        uint64_t maxWorkMicros;
+    };
+
+    PasswordPool(size_t threads, size_t maxQueue, unsigned logN = DEFAULT_LOG_N)
+        : maxQueue(std::max<size_t>(maxQueue, 1)), logN(logN), stop(false),
+          submitted(0), completed(0), rejected(0),
+          totalWaitMicros(0), totalWorkMicros(0), maxWorkMicros(0) {
+        threads = std::max<size_t>(threads, 1);
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+        LOG_INFO("Password pool: " << threads << " threads, queue limit " << this->maxQueue
+                 << ", scrypt N=2^" << logN);
+    }
+
+    ~PasswordPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers) {
+            if (worker.joinable()) worker.join();
+        }
+    }
+
+    PasswordPool(const PasswordPool&) = delete;
+    PasswordPool& operator=(const PasswordPool&) = delete;
+
+    // 非同步雜湊，done(encoded) 在池內執行緒呼叫 (失敗時 encoded 為空)；佇列已滿回傳 false
+    bool hash(std::string password, std::function<void(std::string)> done) {
+        unsigned n = logN;
+        return submit([password = std::move(password), done = std::move(done), n]() mutable {
+            std::string encoded = hashPassword(password, n);
+            OPENSSL_cleanse(&password[0], password.size());
+            done(std::move(encoded));
+        });
+    }
+
+    // 非同步驗證，done(match, legacy)；legacy 表示儲存的是舊的明文密碼
+    bool verify(std::string password, std::string encoded, std::function<void(bool, bool)> done) {
+        return submit([password = std::move(password), encoded = std::move(encoded), done = std::move(done)]() mutable {
+            bool legacy = false;
+            bool match = verifyPassword(password, encoded, legacy);
+            OPENSSL_cleanse(&password[0], password.size());
+            done(match, legacy);
+        });
+    }
+
+    Stats stats() const {
+        Stats s;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            s.queued = jobs.size();
+        }
+        s.threads = workers.size();
+        s.submitted = submitted.load(std::memory_order_relaxed);
+        s.completed = completed.load(std::memory_order_relaxed);
+        s.rejected = rejected.load(std::memory_order_relaxed);
+        s.totalWaitMicros = totalWaitMicros.load(std::memory_order_relaxed);
+        s.totalWorkMicros = totalWorkMicros.load(std::memory_order_relaxed);
+        s.maxWorkMicros = maxWorkMicros.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    static bool isHashed(const std::string& stored) {
+        return stored.compare(0, 8, "$scrypt$") == 0;
+    }
+
+    // 同步雜湊 (在呼叫端執行緒上計算)
+    static std::string hashPassword(const std::string& password, unsigned logN = DEFAULT_LOG_N) {
+        unsigned char salt[SALT_BYTES];
+        unsigned char key[HASH_BYTES];
+        if (RAND_bytes(salt, sizeof(salt)) != 1) return "";
+        const uint64_t r = 8, p = 1;
+        if (!derive(password, salt, sizeof(salt), logN, r, p, key, sizeof(key))) return "";
+
+        char params[48];
+        snprintf(params, sizeof(params), "$scrypt$ln=%u,r=%llu,p=%llu$", logN,
+                 (unsigned long long)r, (unsigned long long)p);
+        return std::string(params) + toHex(salt, sizeof(salt)) + "$" + toHex(key, sizeof(key));
+    }
+
+    // 同步驗證 (常數時間比較)
+    static bool verifyPassword(const std::string& password, const std::string& stored, bool& legacy) {
+        legacy = !isHashed(stored);
+        if (legacy) {
+            return password.size() == stored.size() &&
+                   CRYPTO_memcmp(password.data(), stored.data(), stored.size()) == 0;
+        }
+
+        unsigned logN = 0;
+        unsigned long long r = 0, p = 0;
+        int consumed = 0;
+        if (sscanf(stored.c_str(), "$scrypt$ln=%u,r=%llu,p=%llu$%n", &logN, &r, &p, &consumed) != 3 ||
+            consumed == 0 || logN == 0 || logN > 24) {
+            return false;
+        }
+        size_t split = stored.find('$', consumed);
+        if (split == std::string::npos) return false;
+
+        std::vector<unsigned char> salt, expected;
+        if (!fromHex(stored.substr(consumed, split - consumed), salt) ||
+            !fromHex(stored.substr(split + 1), expected) || expected.empty()) {
+            return false;
+        }
+
+        std::vector<unsigned char> key(expected.size());
+        if (!derive(password, salt.data(), salt.size(), logN, r, p, key.data(), key.size())) return false;
+        bool match = CRYPTO_memcmp(key.data(), expected.data(), key.size()) == 0;
+        OPENSSL_cleanse(key.data(), key.size());
+        return match;
+    }
+
+private:
+    struct Job {
+        std::function<void()> run;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+
+    size_t maxQueue;
+    unsigned logN;
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    bool stop;
+
+    std::atomic<uint64_t> submitted;
+    std::atomic<uint64_t> completed;
+    std::atomic<uint64_t> rejected;
+    std::atomic<uint64_t> totalWaitMicros;
+    std::atomic<uint64_t> totalWorkMicros;
+    std::atomic<uint64_t> maxWorkMicros;
+
+    bool submit(std::function<void()> run) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stop || jobs.size() >= maxQueue) {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            jobs.push_back(Job{std::move(run), std::chrono::steady_clock::now()});
+        }
+        submitted.fetch_add(1, std::memory_order_relaxed);
+        condition.notify_one();
+        return true;
+    }
+
+    void workerLoop() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stop || !jobs.empty(); });
+                if (stop && jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            auto started = std::chrono::steady_clock::now();
+            try {
+                job.run();
+            } catch (const std::exception& e) {
+                LOG_ERROR("Password pool exception: " << e.what());
+            }
+            auto finished = std::chrono::steady_clock::now();
+
+            uint64_t wait = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(started - job.queuedAt).count();
+            uint64_t work = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(finished - started).count();
+            totalWaitMicros.fetch_add(wait, std::memory_order_relaxed);
+            totalWorkMicros.fetch_add(work, std::memory_order_relaxed);
+            uint64_t previous = maxWorkMicros.load(std::memory_order_relaxed);
+            while (work > previous && !maxWorkMicros.compare_exchange_weak(previous, work, std::memory_order_relaxed)) {
+            }
+            completed.fetch_add(1, std::memory_order_relaxed);
+            LOG_SAMPLED(LogLevel::Debug, 5, "Password pool: waited " << wait << "us, worked " << work << "us");
+        }
+    }
+
+    static bool derive(const std::string& password, const unsigned char* salt, size_t saltLength,
+                       unsigned logN, uint64_t r, uint64_t p, unsigned char* out, size_t outLength) {
+        uint64_t n = (uint64_t)1 << logN;
+        // maxmem 需容納 128 * N * r 位元組再加上一些餘裕
+        uint64_t maxmem = 128 * n * r * (p + 1) + (1 << 20);
+        return EVP_PBE_scrypt(password.data(), password.size(), salt, saltLength,
+                              n, r, p, maxmem, out, outLength) == 1;
+    }
+
+    static std::string toHex(const unsigned char* data, size_t size) {
+        static const char hex[] = "0123456789abcdef";
+        std::string result;
+        result.reserve(size * 2);
+        for (size_t i = 0; i < size; ++i) {
+            result += hex[data[i] >> 4];
+            result += hex[data[i] & 0xF];
+        }
+        return result;
+    }
+
+    static bool fromHex(const std::string& text, std::vector<unsigned char>& out) {
+        if (text.size() % 2 != 0) return false;
+        auto value = [](char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        };
+        out.clear();
+        for (size_t i = 0; i < text.size(); i += 2) {
+            int high = value(text[i]), low = value(text[i + 1]);
+            if (high < 0 || low < 0) return false;
+            out.push_back((unsigned char)(high * 16 + low));
+        }
+        return true;
+    }
+};
+
+#endif // PASSWORD_POOL_H
@@ -0,0 +1,209 @@
+#ifndef POOL_STATS_H
+#define POOL_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "Task.h"
+
+/**
+ * Phase 2: 執行緒池統計 (ThreadPool Instrumentation)
+ *
+ * - 每個 worker slot 一份 WorkerStats，只有該 worker 寫入 (relaxed load + store，
+ *   沒有 lock 前綴的原子指令，也不跟其他 worker 搶 cache line)，讀取端合併成快照
+ * - 排隊時間 (送出 -> 開始執行，依優先等級分開) 與執行時間以 log2 微秒分桶的直方圖記錄
+ * - busy/alive 時間算出每個 worker 的使用率；退出後再啟動的 worker 沿用同一個 slot 的累計值
+ * - 快照是累計值，定期回報時以 since() 取兩次快照的差得到該區間的數字
+ */
+
+inline int64_t steadyNanos(std::chrono::steady_clock::time_point t) {
+    return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+struct HistogramSnapshot {
+    static const size_t BUCKETS = 24;  // bucket 0: < 1us；bucket i: [2^(i-1), 2^i) us；最後一格包含以上全部
+
+    uint64_t counts[BUCKETS] = {};
+    uint64_t count = 0;
+    uint64_t sumNanos = 0;
+
+    void merge(const HistogramSnapshot& other) {
+        for (size_t i = 0; i < BUCKETS; ++i) counts[i] += other.counts[i];
+        count += other.count;
+        sumNanos += other.sumNanos;
+    }
+
+    HistogramSnapshot since(const HistogramSnapshot& earlier) const {
+        HistogramSnapshot delta;
+        for (size_t i = 0; i < BUCKETS; ++i) delta.counts[i] = counts[i] - earlier.counts[i];
+        delta.count = count - earlier.count;
+        delta.sumNanos = sumNanos - earlier.sumNanos;
+        return delta;
+    }
+
+    double meanMicros() const { return count == 0 ? 0.0 : (double)sumNanos / count / 1000.0; }
+
+    // 近似百分位數 (回傳所在 bucket 的上界，單位 us)
+    uint64_t percentileMicros(double p) const {
+        if (count == 0) return 0;
+        uint64_t rank = (uint64_t)(p * (double)count);
+        if (rank >= count) rank = count - 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen > rank) return (uint64_t)1 << i;
+        }
+        return (uint64_t)1 << (BUCKETS - 1);
+    }
+
+    static size_t bucketFor(uint64_t nanos) {
+        uint64_t micros = nanos / 1000;
+        size_t bucket = 0;
+        while (micros != 0 && bucket < BUCKETS - 1) {
+            micros >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+};
+
+// 單一寫入者的直方圖 (寫入端不需要原子的 read-modify-write)
+class LatencyHistogram {
+public:
+    void record(uint64_t nanos) {
+        bump(counts[HistogramSnapshot::bucketFor(nanos)], 1);
+        bump(count, 1);
+        bump(sumNanos, nanos);
+    }
+
+    void collect(HistogramSnapshot& out) const {
+        for (size_t i = 0; i < HistogramSnapshot::BUCKETS; ++i) {
+            out.counts[i] += counts[i].load(std::memory_order_relaxed);
+        }
+        out.count += count.load(std::memory_order_relaxed);
+        out.sumNanos += sumNanos.load(std::memory_order_relaxed);
+    }
+
+    static void bump(std::atomic<uint64_t>& value, uint64_t delta) {
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> counts[HistogramSnapshot::BUCKETS] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sumNanos{0};
+};
+
+class alignas(64) WorkerStats {
+public:
+    // worker 執行緒開始/結束時呼叫
+    void started(int64_t now) { runningSince.store(now, std::memory_order_relaxed); }
+    void stopped(int64_t now) {
+        int64_t since = runningSince.load(std::memory_order_relaxed);
+        if (since != 0) LatencyHistogram::bump(aliveNanos, (uint64_t)(now - since));
+        runningSince.store(0, std::memory_order_relaxed);
+    }
+
+    // queuedAt 為 0 表示送出時沒有記錄時間 (不計入排隊時間)
+    void record(TaskPriority priority, int64_t queuedAt, int64_t start, int64_t finish) {
+        if (queuedAt != 0 && start > queuedAt) {
+            queueWait[(size_t)priority].record((uint64_t)(start - queuedAt));
+        }
+        uint64_t ran = finish > start ? (uint64_t)(finish - start) : 0;
+        runTime.record(ran);
+        LatencyHistogram::bump(busyNanos, ran);
+    }
+
+    LatencyHistogram queueWait[TASK_PRIORITY_COUNT];
+    LatencyHistogram runTime;
+    std::atomic<uint64_t> busyNanos{0};
+    std::atomic<uint64_t> aliveNanos{0};
+    std::atomic<int64_t> runningSince{0};   // 0 表示目前沒有 worker 在這個 slot
+};
+
+struct ThreadPoolStats {
+    struct Worker {
+        size_t slot = 0;
+        bool running = false;
+        uint64_t tasks = 0;
+        uint64_t busyNanos = 0;
+        uint64_t aliveNanos = 0;
+
+        double utilization() const { return aliveNanos == 0 ? 0.0 : (double)busyNanos / (double)aliveNanos; }
+    };
+
+    size_t workers = 0;        // 目前的 worker 數
+    size_t queued = 0;         // 尚未開始執行的任務
+    size_t peakQueued = 0;     // 上次 resetPeak 後的最大排隊數
+    HistogramSnapshot queueWait[TASK_PRIORITY_COUNT];
+    HistogramSnapshot runTime;
+    std::vector<Worker> perWorker;   // 每個 slot 一筆 (包含已退出的)
+
+    // 讀取 slot 的累計值並加入快照
+    void collectWorker(size_t slot, const WorkerStats& stats, int64_t now) {
+        Worker worker;
+        worker.slot = slot;
+        for (size_t i = 0; i < TASK_PRIORITY_COUNT; ++i) stats.queueWait[i].collect(queueWait[i]);
+        HistogramSnapshot ran;
+        stats.runTime.collect(ran);
+        runTime.merge(ran);
+        worker.tasks = ran.count;
+        worker.busyNanos = stats.busyNanos.load(std::memory_order_relaxed);
+        worker.aliveNanos = stats.aliveNanos.load(std::memory_order_relaxed);
+        int64_t since = stats.runningSince.load(std::memory_order_relaxed);
+        worker.running = since != 0;
+        if (worker.running && now > since) worker.aliveNanos += (uint64_t)(now - since);
+        if (worker.busyNanos > worker.aliveNanos) worker.busyNanos = worker.aliveNanos;
+        perWorker.push_back(worker);
+    }
+
+    uint64_t completed() const { return runTime.count; }
+
+    // 兩次快照之間的差 (workers/queued/peakQueued 取較新的值)
+    ThreadPoolStats since(const ThreadPoolStats& earlier) const {
+        ThreadPoolStats delta = *this;
+        for (size_t i = 0; i < TASK_PRIORITY_COUNT; ++i) delta.queueWait[i] = queueWait[i].since(earlier.queueWait[i]);
+        delta.runTime = runTime.since(earlier.runTime);
+        for (Worker& worker : delta.perWorker) {
+            for (const Worker& old : earlier.perWorker) {
+                if (old.slot != worker.slot) continue;
+                worker.tasks -= std::min(worker.tasks, old.tasks);
+                worker.busyNanos -= std::min(worker.busyNanos, old.busyNanos);
+                worker.aliveNanos -= std::min(worker.aliveNanos, old.aliveNanos);
+                break;
+            }
+        }
+        return delta;
+    }
+
+    // 一行摘要 (沒有任務的優先等級與從未啟動的 slot 省略)
+    std::string summary() const {
+        static const char* laneNames[TASK_PRIORITY_COUNT] = {"high", "normal", "bulk"};
+        std::ostringstream out;
+        out << "workers=" << workers << " queued=" << queued << " peak=" << peakQueued
+            << " tasks=" << completed() << " wait(us)";
+        for (size_t i = 0; i < TASK_PRIORITY_COUNT; ++i) {
+            if (queueWait[i].count == 0) continue;
+            out << " " << laneNames[i] << " p50/p99=" << queueWait[i].percentileMicros(0.5)
+                << "/" << queueWait[i].percentileMicros(0.99);
+        }
+        out << " run(us) p50/p99/mean=" << runTime.percentileMicros(0.5) << "/"
+            << runTime.percentileMicros(0.99) << "/" << std::fixed << std::setprecision(1)
+            << runTime.meanMicros() << " util=";
+        bool first = true;
+        for (const Worker& worker : perWorker) {
+            if (!worker.running && worker.aliveNanos == 0) continue;
+            out << (first ? "" : "/") << (int)(worker.utilization() * 100 + 0.5) << "%";
+            first = false;
+        }
+        return out.str();
+    }
+};
+
+#endif // POOL_STATS_H
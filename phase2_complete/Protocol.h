@@ -0,0 +1,154 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "Logger.h"
+#include "SocketIO.h"
+
+/**
+ * Phase 2: 長度前綴訊框協議 (Length-prefixed Framing)
+ *
+ * 格式: [4 bytes 長度 (network byte order)][payload]
+ * - Client-Server 指令、回應與推播訊息
+ * - P2P 訊息與檔案傳輸
+ */
+
+// 不可變、以參考計數共享的訊框 (廣播時所有接收者共用同一份)
+using SharedFrame = std::shared_ptr<const std::string>;
+
+class Protocol {
+public:
+    static const size_t HEADER_SIZE = 4;
+
+    // Client-Server 單一訊框上限
+    static size_t getMaxFrameSize() { return 16 * 1024 * 1024; }  // 16MB
+    // 檔案傳輸單一訊框上限
+    static size_t getMaxTransferFrameSize() { return 100 * 1024 * 1024; }  // 100MB
+
+    // 將 payload 包裝成訊框
+    static std::string encodeFrame(const std::string& payload) {
+        std::string frame;
+        frame.reserve(HEADER_SIZE + payload.size());
+        appendFrame(frame, payload);
+        return frame;
+    }
+
+    // 包裝成可共享的訊框
+    static SharedFrame encodeSharedFrame(const std::string& payload) {
+        return std::make_shared<const std::string>(encodeFrame(payload));
+    }
+
+    // 將訊框附加到既有緩衝區 (批次送出多個訊框時使用)
+    static void appendFrame(std::string& out, const std::string& payload) {
+        uint32_t len = htonl((uint32_t)payload.size());
+        out.append((const char*)&len, HEADER_SIZE);
+        out.append(payload);
+    }
+
+    // 阻塞式送出一個訊框 (在 fiber 內等待時改為讓出 carrier，見 SocketIO.h)
+    static bool sendFrame(int socket, const std::string& payload) {
+        std::string frame = encodeFrame(payload);
+        size_t totalSent = 0;
+        while (totalSent < frame.size()) {
+            ssize_t sent = SocketIO::send(socket, frame.data() + totalSent,
+                                        frame.size() - totalSent, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return false;
+            totalSent += sent;
+        }
+        return true;
+    }
+
+    // 阻塞式接收一個訊框
+    static bool recvFrame(int socket, std::string& payload,
+                          size_t maxSize = getMaxFrameSize()) {
+        uint32_t len;
+        if (!recvAll(socket, (char*)&len, sizeof(len))) {
+            return false;
+        }
+        len = ntohl(len);
+
+        if (len > maxSize) {
+            LOG_WARN("Protocol: Frame too large: " << len);
+            return false;
+        }
+
+        payload.resize(len);
+        return len == 0 || recvAll(socket, &payload[0], len);
+    }
+
+private:
+    static bool recvAll(int socket, char* data, size_t len) {
+        size_t totalRecv = 0;
+        while (totalRecv < len) {
+            ssize_t received = SocketIO::recv(socket, data + totalRecv, len - totalRecv, 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) return false;
+            totalRecv += received;
+        }
+        return true;
+    }
+};
+
+/**
+ * 增量式訊框解碼器
+ *
+ * 每條連線一個：把收到的資料 feed 進來，再用 next() 逐一取出完整訊框。
+ * 訊框可以跨多次 recv，也可以一次 recv 收到多個訊框。
+ */
+class FrameDecoder {
+private:
+    std::string buffer;
+    size_t readOffset;
+    size_t maxFrameSize;
+    bool error;
+
+public:
+    explicit FrameDecoder(size_t maxSize = Protocol::getMaxFrameSize())
+        : readOffset(0), maxFrameSize(maxSize), error(false) {}
+
+    void feed(const char* data, size_t len) {
+        // 已消化的部分累積夠多時才搬移，避免每個訊框都搬一次
+        if (readOffset > 0 && readOffset >= buffer.size() / 2) {
+            buffer.erase(0, readOffset);
+            readOffset = 0;
+        }
+        buffer.append(data, len);
+    }
+
+    // 取出下一個完整訊框，資料不足或格式錯誤時回傳 false
+    bool next(std::string& payload) {
+        if (error) return false;
+        size_t available = buffer.size() - readOffset;
+        if (available < Protocol::HEADER_SIZE) return false;
+
+        uint32_t len;
+        memcpy(&len, buffer.data() + readOffset, sizeof(len));
+        len = ntohl(len);
+        if (len > maxFrameSize) {
+            error = true;
+            return false;
+        }
+        if (available < Protocol::HEADER_SIZE + len) return false;
+
+        payload.assign(buffer, readOffset + Protocol::HEADER_SIZE, len);
+        readOffset += Protocol::HEADER_SIZE + len;
+        if (readOffset == buffer.size()) {
+            buffer.clear();
+            readOffset = 0;
+        }
+        return true;
+    }
+
+    bool hasError() const { return error; }
+    size_t bufferedBytes() const { return buffer.size() - readOffset; }
+};
+
+#endif // PROTOCOL_H
@@ -0,0 +1,103 @@
+#ifndef ROOM_HISTORY_H
+#define ROOM_HISTORY_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Phase 2: 群組訊息歷史 (固定容量 ring buffer)
+ *
+ * - 每則訊息有單調遞增的序號 (從 1 開始)
+ * - 超過訊息數或位元組上限時淘汰最舊的訊息
+ * - 依序號往回分頁：pageBefore(beforeSeq, limit)
+ *
+ * 非執行緒安全，由 ChatRoom::room_mutex 保護。
+ */
+class RoomHistory {
+public:
+    struct Message {
+        uint64_t seq;
+        std::string sender;
+        std::string text;
+    };
+
+    RoomHistory(size_t maxMessages, size_t maxBytes)
+        : maxMessages(std::max<size_t>(maxMessages, 1)), maxBytes(maxBytes),
+          head(0), count(0), totalBytes(0), nextSeq(1) {}
+
+    // 新增訊息並回傳序號
+    uint64_t append(const std::string& sender, std::string text) {
+        if (count == slots.size()) {
+            if (slots.size() < maxMessages) {
+                grow();
+            } else {
+                evictOldest();
+            }
+        }
+
+        Message& slot = slots[(head + count) % slots.size()];
+        slot.seq = nextSeq++;
+        slot.sender = sender;
+        slot.text = std::move(text);
+        totalBytes += slot.sender.size() + slot.text.size();
+        ++count;
+
+        // 位元組上限：至少保留最新的一則
+        while (totalBytes > maxBytes && count > 1) {
+            evictOldest();
+        }
+        return slot.seq;
+    }
+
+    // 依序號由舊到新走訪 seq < beforeSeq 的最後 limit 則 (beforeSeq 為 0 表示從最新開始)
+    // fn(seq, sender, text)，與 SegmentLog::pageBefore 相同
+    template <typename F>
+    void pageBefore(uint64_t beforeSeq, size_t limit, F&& fn) const {
+        uint64_t end = (beforeSeq == 0 || beforeSeq > nextSeq) ? nextSeq : beforeSeq;
+        uint64_t oldest = oldestSeq();
+        if (end <= oldest) return;
+
+        uint64_t start = (end - oldest > limit) ? end - limit : oldest;
+        for (uint64_t seq = start; seq < end; ++seq) {
+            const Message& msg = slots[(head + (seq - oldest)) % slots.size()];
+            fn(msg.seq, std::string_view(msg.sender), std::string_view(msg.text));
+        }
+    }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    size_t bytes() const { return totalBytes; }
+    uint64_t oldestSeq() const { return nextSeq - count; }
+    uint64_t latestSeq() const { return nextSeq - 1; }
+
+private:
+    size_t maxMessages;
+    size_t maxBytes;
+    std::vector<Message> slots;  // 依需要成長到 maxMessages 後固定
+    size_t head;                 // 最舊訊息的位置
+    size_t count;
+    size_t totalBytes;
+    uint64_t nextSeq;
+
+    // 容量未滿時加倍，先把內容轉正讓最舊的訊息回到 0
+    void grow() {
+        std::rotate(slots.begin(), slots.begin() + head, slots.end());
+        head = 0;
+        size_t capacity = std::min(std::max<size_t>(slots.size() * 2, 16), maxMessages);
+        slots.resize(capacity);
+    }
+
+    void evictOldest() {
+        Message& oldest = slots[head];
+        totalBytes -= oldest.sender.size() + oldest.text.size();
+        std::string().swap(oldest.sender);
+        std::string().swap(oldest.text);
+        head = (head + 1) % slots.size();
+        --count;
+    }
+};
+
+#endif // ROOM_HISTORY_H
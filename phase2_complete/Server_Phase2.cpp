@@ -10,6 +10,8 @@
 #include <exception>
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
 #include <atomic>
 #include <queue>
 #include <memory>
@@ -17,677 +19,1289 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <sys/resource.h>
 #include "ThreadPool.h"
 #include "Crypto.h"
+#include "EventLoop.h"
+#include "CommandParser.h"
+#include "Logger.h"
+#include "UserRegistry.h"
+#include "DirectoryCache.h"
+#include "RoomHistory.h"
+#include "HistoryStore.h"
+#include "UserStore.h"
+#include "PasswordPool.h"
 
 using namespace std;
 
-struct User {
-    string username;
-    string password;
-    bool isOnline;
-    string clientIP;
-    int clientPort;
-    int clientSocket;  // 用於群組訊息推送
-    
-    User() : isOnline(false), clientPort(0), clientSocket(-1) {}
-    User(string user, string pass) : username(user), password(pass), isOnline(false), clientPort(0), clientSocket(-1) {}
-};
-
 // 群組結構
 struct ChatRoom {
     string roomName;
     string creator;
-    set<string> members;
-    vector<pair<string, string>> messageHistory;  // (sender, message)
-    mutable shared_ptr<mutex> room_mutex;
+    set<string, less<>> members;
+    RoomHistory history;          // 沒有持久化時的記憶體歷史
+    unique_ptr<SegmentLog> log;   // 持久化歷史 (mmap segment)，存在時取代 history
+    mutable mutex room_mutex;  // 保護 members 與歷史
     
-    ChatRoom() : room_mutex(make_shared<mutex>()) {}
-    ChatRoom(const string& name, const string& owner) 
-        : roomName(name), creator(owner), room_mutex(make_shared<mutex>()) {
+    ChatRoom(const string& name, const string& owner, size_t historyMessages, size_t historyBytes,
+             unique_ptr<SegmentLog> segmentLog) 
+        : roomName(name), creator(owner), history(historyMessages, historyBytes), log(move(segmentLog)) {
         members.insert(owner);
     }
+    
+    // 以下需持有 room_mutex
+    uint64_t appendHistory(const string& sender, string_view text) {
+        return log ? log->append(sender, text) : history.append(sender, string(text));
+    }
+    
+    template <typename F>
+    void pageHistory(uint64_t beforeSeq, size_t limit, F&& fn) const {
+        if (log) log->pageBefore(beforeSeq, limit, fn);
+        else history.pageBefore(beforeSeq, limit, fn);
+    }
+    
+    bool historyEmpty() const { return log ? log->empty() : history.empty(); }
+    uint64_t oldestHistorySeq() const { return log ? log->oldestSeq() : history.oldestSeq(); }
 };
 
 class ChatServer {
 private:
-    int serverSocket;
     int serverPort;
-    map<string, User> users;
-    mutable mutex users_mutex;
+    UserRegistry users;
+    UserStore userStore;      // 帳號的 WAL 與快照 (CHAT_USER_DIR)
+    OnlineIndex onlineUsers;  // 上線用戶與 P2P 端點
+    
+    // LIST / LIST_ROOMS 的版本化快取
+    DirectoryCache userDirectory{"ONLINE_USERS", "No users online"};
+    DirectoryCache roomDirectory{"ROOMS", "No rooms available"};
     atomic<int> clientCounter{0};
     
     // Phase 2: 群組聊天
-    map<string, ChatRoom> chatRooms;
-    mutable mutex rooms_mutex;
+    // rooms_mutex 只保護表本身 (查詢/新增)，取得 handle 後只持有該房間的 room_mutex
+    map<string, shared_ptr<ChatRoom>, less<>> chatRooms;
+    set<string, less<>> openingRooms;  // 正在開啟歷史的房間名稱 (先保留名稱，表鎖外開檔)
+    mutable shared_mutex rooms_mutex;
+    
+    // 每個房間的歷史上限 (CHAT_HISTORY_MESSAGES / CHAT_HISTORY_BYTES)
+    static const size_t MAX_HISTORY_PAGE = 100;
+    size_t historyMaxMessages;
+    size_t historyMaxBytes;
+    HistoryStore historyStore;  // CHAT_HISTORY_DIR 下的持久化歷史
+    
+    // CPU 配置 (CHAT_IO_CPUS / CHAT_WORKER_CPUS / CHAT_WORKER_PIN / CHAT_NUMA_NODE)
+    struct CpuPlan {
+        CpuPlacement reactors;   // 事件迴圈 (逐個固定時依 index 選核心)
+        CpuPlacement workers;    // ThreadPool 的 worker
+    };
+    CpuPlan cpuPlan;
     
-    // Phase 2: Professional ThreadPool
+    // Phase 2: Professional ThreadPool (負責指令處理)
     ThreadPool thread_pool;
     
+    // 密碼雜湊/驗證專用的執行緒池 (CHAT_KDF_THREADS / CHAT_KDF_QUEUE)
+    PasswordPool passwordPool;
+    
+    // 定期把執行緒池統計寫進 log (CHAT_STATS_INTERVAL_S)
+    chrono::seconds statsInterval;
+    thread statsThread;
+    mutex stats_mutex;
+    condition_variable statsWakeup;
+    bool statsStopping = false;
+    
+    // Phase 2: 事件迴圈 (負責所有連線的 I/O)
+    // 每個事件迴圈有自己的 SO_REUSEPORT listen socket 與執行緒
+    int reactorCount;
+    vector<unique_ptr<EventLoop>> eventLoops;
+    vector<int> listenSockets;
+    vector<thread> reactorThreads;
+    
     // Phase 2: 加密模組
     Crypto crypto;
     bool encryptionEnabled;
     
-    // 客戶端 socket 映射（用於訊息推送）
-    map<string, int> userSockets;
-    mutable mutex sockets_mutex;
+    // 客戶端連線映射（用於訊息推送）
+    map<string, shared_ptr<Connection>> userSockets;
+    mutable shared_mutex sockets_mutex;
     
 public:
-    ChatServer(int port) : serverPort(port), thread_pool(10), encryptionEnabled(true) {
-        cout << "=== Phase 2 ChatServer (Complete) ===" << endl;
-        cout << "Features:" << endl;
-        cout << "  ✅ Professional ThreadPool (10 workers)" << endl;
-        cout << "  ✅ P2P User Discovery" << endl;
-        cout << "  ✅ OpenSSL Encryption (AES-256-CBC)" << endl;
-        cout << "  ✅ Group Chat (Relay Mode)" << endl;
+    ChatServer(int port, int reactors = 1, bool pin = false) 
+        : serverPort(port),
+          userStore(envString("CHAT_USER_DIR", "chat_users"), envSize("CHAT_USER_SNAPSHOT_EVERY", 10000)),
+          historyMaxMessages(envSize("CHAT_HISTORY_MESSAGES", 1000)),
+          historyMaxBytes(envSize("CHAT_HISTORY_BYTES", 1024 * 1024)),
+          historyStore(envString("CHAT_HISTORY_DIR", "chat_history"),
+                       envSize("CHAT_HISTORY_SEGMENT_BYTES", 4 * 1024 * 1024),
+                       envSize("CHAT_HISTORY_SEGMENTS", 16)),
+          cpuPlan(envCpuPlan(pin)),
+          thread_pool(envPoolSizing(), envScheduler(), cpuPlan.workers),
+          passwordPool(envSize("CHAT_KDF_THREADS", max(1u, thread::hardware_concurrency() / 2)),
+                       envSize("CHAT_KDF_QUEUE", 256)),
+          statsInterval(envSize("CHAT_STATS_INTERVAL_S", 60)),
+          reactorCount(reactors),
+          encryptionEnabled(true) {
+#ifndef SO_REUSEPORT
+        // 不支援 SO_REUSEPORT 時只能使用單一 listen socket
+        reactorCount = 1;
+#endif
+        if (reactorCount < 1) reactorCount = 1;
+        
+        LOG_INFO("=== Phase 2 ChatServer (Complete) ===");
+        LOG_INFO("Features:");
+        LOG_INFO("  ✅ Professional ThreadPool (" << thread_pool.getSizing().minThreads << "-"
+                 << thread_pool.getSizing().maxThreads << " workers)");
+        LOG_INFO("  ✅ Event-driven I/O (epoll/kqueue, " << reactorCount << " reactors)");
+        LOG_INFO("  ✅ P2P User Discovery");
+        LOG_INFO("  ✅ OpenSSL Encryption (AES-256-CBC)");
+        LOG_INFO("  ✅ Group Chat (Relay Mode)");
+        if (historyStore.enabled()) {
+            LOG_INFO("  ✅ Persistent Room History (" << historyStore.directory() << ")");
+        }
+        
+        size_t loadedUsers = userStore.load(users);
+        if (userStore.enabled()) {
+            LOG_INFO("  ✅ Persistent Accounts (" << userStore.directory() << ", " << loadedUsers << " users loaded)");
+        }
         
         // 測試加密功能
         if (crypto.selfTest()) {
-            cout << "🔐 Server encryption enabled" << endl;
+            LOG_INFO("🔐 Server encryption enabled");
         } else {
-            cerr << "⚠️ Encryption self-test failed, disabling encryption" << endl;
+            LOG_WARN("⚠️ Encryption self-test failed, disabling encryption");
             encryptionEnabled = false;
         }
     }
     
-    bool startServer() {
-        serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-        if (serverSocket < 0) {
-            perror("Socket creation failed");
-            return false;
+    // 建立一個 listen socket (多個事件迴圈時使用 SO_REUSEPORT 共用同一個 port)
+    int createListenSocket() {
+        int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenSocket < 0) {
+            LOG_ERROR("Socket creation failed: " << strerror(errno));
+            return -1;
         }
         
         int opt = 1;
-        if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-            perror("setsockopt failed");
-            return false;
+        if (setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+            LOG_ERROR("setsockopt failed: " << strerror(errno));
+            close(listenSocket);
+            return -1;
         }
         
+#ifdef SO_REUSEPORT
+        if (reactorCount > 1 &&
+            setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+            LOG_ERROR("setsockopt SO_REUSEPORT failed: " << strerror(errno));
+            close(listenSocket);
+            return -1;
+        }
+#endif
+        
         struct sockaddr_in serverAddr;
+        memset(&serverAddr, 0, sizeof(serverAddr));
         serverAddr.sin_family = AF_INET;
         serverAddr.sin_addr.s_addr = INADDR_ANY;
         serverAddr.sin_port = htons(serverPort);
         
-        if (::bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-            perror("Bind failed");
-            return false;
+        if (::bind(listenSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+            LOG_ERROR("Bind failed: " << strerror(errno));
+            close(listenSocket);
+            return -1;
         }
         
-        if (listen(serverSocket, 10) < 0) {
-            perror("Listen failed");
-            return false;
+        if (listen(listenSocket, SOMAXCONN) < 0) {
+            LOG_ERROR("Listen failed: " << strerror(errno));
+            close(listenSocket);
+            return -1;
         }
         
-        cout << "Server started on port " << serverPort << endl;
-        cout << "Worker Pool: " << thread_pool.getWorkerCount() << " workers ready" << endl;
-        return true;
+        return listenSocket;
     }
     
-    void handleClient(int clientSocket, string clientIP, int clientId) {
-        char buffer[4096];
-        string currentUser = "";
+    bool startServer() {
+        // 大量閒置連線需要足夠的 file descriptor
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
         
-        cout << "[Client " << clientId << "] Started handling " << clientIP 
-             << " (Worker: " << this_thread::get_id() << ")" << endl;
+        for (int i = 0; i < reactorCount; ++i) {
+            int listenSocket = createListenSocket();
+            if (listenSocket < 0) {
+                return false;
+            }
+            listenSockets.push_back(listenSocket);
+            
+            unique_ptr<EventLoop> loop(new EventLoop(clientCounter));
+            if (!loop->init(listenSocket)) {
+                return false;
+            }
+            loop->setCallbacks(
+                [this](const shared_ptr<Connection>& conn) { this->onConnectionOpen(conn); },
+                [this](const shared_ptr<Connection>& conn, string&& command) {
+                    this->onConnectionMessage(conn, std::move(command));
+                },
+                [this](const shared_ptr<Connection>& conn) { this->onConnectionClose(conn); });
+            eventLoops.push_back(std::move(loop));
+        }
         
-        try {
-            while (true) {
-                memset(buffer, 0, sizeof(buffer));
-                int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-                
-                if (bytesReceived <= 0) {
-                    if (bytesReceived == 0) {
-                        cout << "[Client " << clientId << "] Disconnected gracefully" << endl;
-                    } else {
-                        cout << "[Client " << clientId << "] Disconnected with error" << endl;
-                    }
-                    break;
-                }
-                
-                buffer[bytesReceived] = '\0';
-                string message(buffer);
-                
-                // 清理訊息
-                size_t pos = message.find_last_not_of(" \n\r\t");
-                if (pos != string::npos) {
-                    message.erase(pos + 1);
-                }
-                
-                // 檢查是否為加密訊息
-                string decryptedMessage = message;
-                bool wasEncrypted = false;
-                
-                if (Crypto::isEncryptedMessage(message)) {
-                    decryptedMessage = crypto.decryptMessage(message);
-                    wasEncrypted = true;
-                    if (decryptedMessage.empty()) {
-                        string errorResponse = "ERROR: Decryption failed";
-                        send(clientSocket, errorResponse.c_str(), errorResponse.length(), 0);
-                        continue;
-                    }
-                }
-                
-                cout << "[Client " << clientId << "] Received: [" << decryptedMessage << "]";
-                if (wasEncrypted) cout << " (decrypted)";
-                cout << endl;
-                
-                if (decryptedMessage.empty()) continue;
-                
-                // 處理指令
-                string response;
-                try {
-                    response = processCommand(decryptedMessage, currentUser, clientIP, clientId, clientSocket);
-                } catch (const exception& e) {
-                    response = "ERROR: Command processing failed";
-                }
-                
-                // 加密回應（如果需要）
-                string finalResponse = response;
-                if (wasEncrypted && encryptionEnabled) {
-                    string encrypted = crypto.encryptMessage(response);
-                    if (!encrypted.empty()) {
-                        finalResponse = encrypted;
-                    }
-                }
-                
-                cout << "[Client " << clientId << "] Sending: [" << response << "]" << endl;
-                
-                ssize_t sent = send(clientSocket, finalResponse.c_str(), finalResponse.length(), 0);
-                if (sent <= 0) break;
-                
-                if (decryptedMessage.find("LOGOUT") == 0) {
-                    break;
-                }
+        LOG_INFO("Server started on port " << serverPort);
+        LOG_INFO("Reactors: " << eventLoops.size() << " event loops"
+                 << (cpuPlan.reactors.enabled() ? " on " + cpuPlan.reactors.describe() : ""));
+        LOG_INFO("Worker Pool: " << thread_pool.getWorkerCount() << " workers ready (max "
+                 << thread_pool.getSizing().maxThreads << ")");
+        return true;
+    }
+    
+    // ========== 連線事件 (由事件迴圈呼叫) ==========
+    
+    void onConnectionOpen(const shared_ptr<Connection>& conn) {
+        LOG_INFO("[Client " << conn->getId() << "] New connection from " << conn->getIP());
+    }
+    
+    // 收到完整指令：放入連線的待處理佇列，同一連線的指令依序處理
+    void onConnectionMessage(const shared_ptr<Connection>& conn, string&& command) {
+        bool schedule = false;
+        {
+            lock_guard<mutex> lock(conn->inbound_mutex);
+            conn->pendingCommands.push_back(std::move(command));
+            if (!conn->processing) {
+                conn->processing = true;
+                schedule = true;
             }
+        }
+        if (schedule) scheduleConnection(conn);
+    }
+    
+    void onConnectionClose(const shared_ptr<Connection>& conn) {
+        bool schedule = false;
+        {
+            lock_guard<mutex> lock(conn->inbound_mutex);
+            conn->disconnected = true;
+            if (!conn->processing) {
+                conn->processing = true;
+                schedule = true;
+            }
+        }
+        if (schedule) scheduleConnection(conn);
+    }
+    
+    // 有新指令的連線走 High (登入回覆、房間轉送等互動指令)；
+    // 一輪處理不完、讓出 worker 的連線降為 Normal，大量送指令的連線不會擠掉其他人
+    void scheduleConnection(const shared_ptr<Connection>& conn, TaskPriority priority = TaskPriority::High) {
+        try {
+            thread_pool.post(priority, [this, conn]() {
+                this->drainConnection(conn);
+            });
         } catch (const exception& e) {
-            cout << "[Client " << clientId << "] Exception: " << e.what() << endl;
+            LOG_ERROR("[Client " << conn->getId() << "] Failed to enqueue: " << e.what());
         }
-        
-        // 清理
-        if (!currentUser.empty()) {
-            // 離開所有群組
-            leaveAllRooms(currentUser);
-            
-            // 移除 socket 映射
+    }
+    
+    // 在 worker 中處理連線的待處理指令
+    void drainConnection(const shared_ptr<Connection>& conn) {
+        // 每次最多處理固定數量的指令，避免單一連線佔住 worker
+        const int MAX_COMMANDS_PER_TURN = 16;
+        
+        for (int handled = 0; handled < MAX_COMMANDS_PER_TURN; ++handled) {
+            string command;
+            bool finished = false;
             {
-                lock_guard<mutex> lock(sockets_mutex);
-                userSockets.erase(currentUser);
+                lock_guard<mutex> lock(conn->inbound_mutex);
+                if (conn->pendingCommands.empty()) {
+                    if (!conn->disconnected) {
+                        conn->processing = false;
+                        return;
+                    }
+                    finished = true;
+                } else {
+                    command = std::move(conn->pendingCommands.front());
+                    conn->pendingCommands.pop_front();
+                }
             }
             
-            // 更新用戶狀態
-            {
-                lock_guard<mutex> lock(users_mutex);
-                auto it = users.find(currentUser);
-                if (it != users.end()) {
-                    it->second.isOnline = false;
-                    it->second.clientSocket = -1;
-                }
+            if (finished) {
+                // 連線已關閉且指令都處理完 (processing 維持 true，不會再被排程)
+                cleanupConnection(conn);
+                return;
+            }
+            if (handleCommand(conn, command)) {
+                // 指令改為非同步完成 (例如 LOGIN 等待密碼池)：processing 維持 true，
+                // 同一連線後面的指令要等 continueCommand 回覆後才繼續處理
+                return;
             }
         }
         
-        close(clientSocket);
-        cout << "[Client " << clientId << "] Handler finished" << endl;
+        // 讓出 worker，重新排到佇列尾端
+        scheduleConnection(conn, TaskPriority::Normal);
     }
     
-    string processCommand(const string& command, string& currentUser, const string& clientIP, 
-                         int clientId, int clientSocket) {
-        stringstream ss(command);
-        string cmd;
-        ss >> cmd;
-        
-        if (cmd.empty()) return "ERROR: Empty command";
+    // 指令回應的去向：延後完成的指令回覆時也要帶回原本的 request ID 與加密方式
+    struct ReplyRoute {
+        string requestTag;
+        bool encrypted;
+    };
+    
+    // 回傳 true 表示指令已轉為非同步，回覆由 continueCommand 送出
+    bool handleCommand(const shared_ptr<Connection>& conn, string message) {
+        int clientId = conn->getId();
+        
+        // 清理訊息
+        size_t pos = message.find_last_not_of(" \n\r\t");
+        if (pos != string::npos) {
+            message.erase(pos + 1);
+        }
         
-        transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
+        // 檢查是否為加密訊息
+        string decryptedMessage = message;
+        bool wasEncrypted = false;
         
-        // 基本命令
-        if (cmd == "REGISTER") {
-            string username, password;
-            ss >> username >> password;
-            return handleRegister(username, password, clientId);
-        }
-        else if (cmd == "LOGIN") {
-            string username, password;
-            int port;
-            ss >> username >> password >> port;
-            if (ss.fail()) return "ERROR: Invalid login format";
-            
-            string result = handleLogin(username, password, clientIP, port, clientId, clientSocket);
-            if (result == "LOGIN_SUCCESS") {
-                currentUser = username;
-                // 儲存 socket 映射
-                lock_guard<mutex> lock(sockets_mutex);
-                userSockets[username] = clientSocket;
+        if (Crypto::isEncryptedMessage(message)) {
+            decryptedMessage = crypto.decryptMessage(message);
+            wasEncrypted = true;
+            if (decryptedMessage.empty()) {
+                conn->send(Protocol::encodeFrame("ERROR: Decryption failed"));
+                return false;
             }
-            return result;
-        }
-        else if (cmd == "LOGOUT") {
-            string result = handleLogout(currentUser, clientId);
-            if (result == "LOGOUT_SUCCESS") {
-                leaveAllRooms(currentUser);
-                lock_guard<mutex> lock(sockets_mutex);
-                userSockets.erase(currentUser);
-                currentUser = "";
-            }
-            return result;
-        }
-        else if (cmd == "LIST") {
-            return handleListUsers(clientId);
-        }
-        else if (cmd == "MESSAGE") {
-            string msg;
-            getline(ss, msg);
-            return handleMessage(currentUser, msg, clientId);
-        }
-        else if (cmd == "GET_USER_INFO") {
-            string targetUser;
-            ss >> targetUser;
-            return handleGetUserInfo(targetUser, currentUser, clientId);
-        }
-        else if (cmd == "ENCRYPTION_STATUS") {
-            return encryptionEnabled ? "ENCRYPTION_STATUS:ENABLED:AES-256-CBC" : "ENCRYPTION_STATUS:DISABLED";
-        }
-        // ========== 群組聊天命令 ==========
-        else if (cmd == "CREATE_ROOM") {
-            string roomName;
-            ss >> roomName;
-            return handleCreateRoom(roomName, currentUser, clientId);
-        }
-        else if (cmd == "JOIN_ROOM") {
-            string roomName;
-            ss >> roomName;
-            return handleJoinRoom(roomName, currentUser, clientId);
         }
-        else if (cmd == "LEAVE_ROOM") {
-            string roomName;
-            ss >> roomName;
-            return handleLeaveRoom(roomName, currentUser, clientId);
+        
+        LOG_SAMPLED(LogLevel::Info, 20, "[Client " << clientId << "] Received: [" << decryptedMessage << "]"
+                    << (wasEncrypted ? " (decrypted)" : ""));
+        
+        // 取出 request ID ("#<id> <command>")，回應時原樣帶回，
+        // 讓 client 可以同時送出多個指令並依 ID 對應回應
+        string requestTag;
+        if (!decryptedMessage.empty() && decryptedMessage[0] == '#') {
+            size_t space = decryptedMessage.find(' ');
+            requestTag = decryptedMessage.substr(0, space);
+            decryptedMessage = (space == string::npos) ? "" : decryptedMessage.substr(space + 1);
         }
-        else if (cmd == "LIST_ROOMS") {
-            return handleListRooms(clientId);
+        
+        if (decryptedMessage.empty() && requestTag.empty()) return false;
+        
+        // 處理指令
+        ReplyRoute route{requestTag, wasEncrypted};
+        bool suspended = false;
+        string response;
+        if (decryptedMessage.empty()) {
+            response = "ERROR: Empty command";
+        } else {
+            try {
+                response = processCommand(decryptedMessage, conn->currentUser, conn->getIP(), clientId, conn,
+                                          route, suspended);
+            } catch (const exception& e) {
+                response = "ERROR: Command processing failed";
+            }
         }
-        else if (cmd == "ROOM_MEMBERS") {
-            string roomName;
-            ss >> roomName;
-            return handleRoomMembers(roomName, currentUser, clientId);
+        if (suspended) return true;
+        
+        sendReply(conn, route, std::move(response));
+        return false;
+    }
+    
+    void sendReply(const shared_ptr<Connection>& conn, const ReplyRoute& route, string response) {
+        if (!route.requestTag.empty()) {
+            response = route.requestTag + " " + response;
         }
-        else if (cmd == "ROOM_MSG") {
-            string roomName;
-            ss >> roomName;
-            string msg;
-            getline(ss, msg);
-            // 去除前導空格
-            if (!msg.empty() && msg[0] == ' ') msg = msg.substr(1);
-            return handleRoomMessage(roomName, currentUser, msg, clientId);
+        
+        // 加密回應（如果需要）
+        string finalResponse = response;
+        if (route.encrypted && encryptionEnabled) {
+            string encrypted = crypto.encryptMessage(response);
+            if (!encrypted.empty()) {
+                finalResponse = encrypted;
+            }
         }
-        else if (cmd == "ROOM_HISTORY") {
-            string roomName;
-            ss >> roomName;
-            return handleRoomHistory(roomName, currentUser, clientId);
+        
+        LOG_SAMPLED(LogLevel::Info, 20, "[Client " << conn->getId() << "] Sending: [" << response << "]");
+        conn->send(Protocol::encodeFrame(finalResponse));
+    }
+    
+    // 非同步指令完成：回到 ThreadPool 執行後續處理、送出回覆，再繼續處理該連線的指令
+    // (呼叫端多半是密碼池或 WAL committer 的執行緒，不在那裡做其他工作)
+    // finish 回傳空字串表示指令再次轉為非同步，回覆由下一個 continueCommand 送出
+    void continueCommand(const shared_ptr<Connection>& conn, const ReplyRoute& route, function<string()> finish) {
+        auto task = [this, conn, route, finish = std::move(finish)]() {
+            string response;
+            try {
+                response = finish();
+            } catch (const exception& e) {
+                response = "ERROR: Command processing failed";
+            }
+            if (response.empty()) return;
+            sendReply(conn, route, std::move(response));
+            drainConnection(conn);
+        };
+        try {
+            thread_pool.post(TaskPriority::High, task);
+        } catch (const exception& e) {
+            // 佇列無法接受 (例如關閉中) 時就地完成，連線不會一直停在 processing
+            LOG_ERROR("[Client " << conn->getId() << "] Failed to enqueue: " << e.what() << ", finishing inline");
+            task();
         }
-        else {
-            return "ERROR: Unknown command: " + cmd;
+    }
+    
+    // 連線關閉後的清理
+    void cleanupConnection(const shared_ptr<Connection>& conn) {
+        const string& currentUser = conn->currentUser;
+        
+        if (!currentUser.empty()) {
+            // 離開所有群組
+            leaveAllRooms(currentUser);
+            
+            // 移除 socket 映射
+            {
+                lock_guard<shared_mutex> lock(sockets_mutex);
+                auto it = userSockets.find(currentUser);
+                if (it != userSockets.end() && it->second == conn) {
+                    userSockets.erase(it);
+                }
+            }
+            
+            // 更新用戶狀態
+            users.update(currentUser, [](User& user) {
+                user.isOnline = false;
+                user.clientSocket = -1;
+            });
+            if (onlineUsers.release(currentUser)) {
+                userDirectory.invalidate();
+            }
         }
+        
+        LOG_INFO("[Client " << conn->getId() << "] Disconnected");
     }
     
-    // ========== 基本用戶管理 ==========
+    // 單一指令的執行環境 (分派時傳給各個指令處理函式)
+    struct CommandContext {
+        string& currentUser;
+        const string& clientIP;
+        int clientId;
+        const shared_ptr<Connection>& conn;
+        string_view verb;
+        const ReplyRoute& route;
+        bool& suspended;  // 設為 true 表示回覆改由 continueCommand 送出
+    };
+    
+    using CommandHandler = string (ChatServer::*)(CommandContext&, CommandTokenizer&);
+    
+    string processCommand(string_view command, string& currentUser, const string& clientIP, 
+                         int clientId, const shared_ptr<Connection>& conn,
+                         const ReplyRoute& route, bool& suspended) {
+        // 分派表：索引為 CommandVerb，順序必須與列舉一致
+        static const CommandHandler handlers[(size_t)CommandVerb::Count] = {
+            &ChatServer::commandUnknown,
+            &ChatServer::commandRegister,
+            &ChatServer::commandLogin,
+            &ChatServer::commandLogout,
+            &ChatServer::commandList,
+            &ChatServer::commandMessage,
+            &ChatServer::commandGetUserInfo,
+            &ChatServer::commandEncryptionStatus,
+            &ChatServer::commandCreateRoom,
+            &ChatServer::commandJoinRoom,
+            &ChatServer::commandLeaveRoom,
+            &ChatServer::commandListRooms,
+            &ChatServer::commandRoomMembers,
+            &ChatServer::commandRoomMsg,
+            &ChatServer::commandRoomHistory,
+        };
+        
+        CommandTokenizer args(command);
+        string_view verb = args.next();
+        if (verb.empty()) return "ERROR: Empty command";
+        
+        CommandContext ctx{currentUser, clientIP, clientId, conn, verb, route, suspended};
+        return (this->*handlers[(size_t)CommandParser::lookupVerb(verb)])(ctx, args);
+    }
+    
+    // ========== 指令分派 ==========
     
-    string handleRegister(const string& username, const string& password, int clientId) {
+    string commandUnknown(CommandContext& ctx, CommandTokenizer&) {
+        return "ERROR: Unknown command: " + CommandParser::upperVerb(ctx.verb);
+    }
+    
+    // REGISTER / LOGIN 的 KDF 在密碼池計算，指令暫停，完成後由 continueCommand 回覆
+    string commandRegister(CommandContext& ctx, CommandTokenizer& args) {
+        string_view username = args.next();
+        string_view password = args.next();
         if (username.empty() || password.empty()) {
             return "ERROR: Username and password cannot be empty";
         }
-        
-        lock_guard<mutex> lock(users_mutex);
-        if (users.find(username) != users.end()) {
+        // 名稱已被使用時不必花時間雜湊 (雜湊完成後 insert 仍會再檢查一次)
+        if (users.read(username, [](const User&) {})) {
             return "ERROR: Username already exists";
         }
         
-        users[username] = User(username, password);
-        cout << "[Client " << clientId << "] Registered: " << username << endl;
-        return "REGISTER_SUCCESS";
+        shared_ptr<Connection> conn = ctx.conn;
+        ReplyRoute route = ctx.route;
+        string name(username);
+        bool queued = passwordPool.hash(string(password), [this, conn, route, name](string encoded) {
+            continueCommand(conn, route, [this, conn, route, name, encoded = std::move(encoded)]() {
+                if (encoded.empty()) return string("ERROR: Registration failed");
+                return handleRegister(conn, route, name, encoded);
+            });
+        });
+        if (!queued) return "ERROR: Server busy, try again later";
+        ctx.suspended = true;
+        return "";
     }
     
-    string handleLogin(const string& username, const string& password, const string& clientIP, 
-                      int port, int clientId, int clientSocket) {
-        if (username.empty() || password.empty()) {
-            return "ERROR: Username and password cannot be empty";
+    string commandLogin(CommandContext& ctx, CommandTokenizer& args) {
+        string_view username = args.next();
+        string_view password = args.next();
+        int port;
+        if (username.empty() || password.empty() || !args.nextInt(port)) {
+            return "ERROR: Invalid login format";
         }
-        
         if (port <= 1024 || port > 65535) {
             return "ERROR: Port must be between 1025 and 65535";
         }
         
-        lock_guard<mutex> lock(users_mutex);
-        
-        auto it = users.find(username);
-        if (it == users.end()) return "ERROR: User not found";
-        if (it->second.password != password) return "ERROR: Wrong password";
-        if (it->second.isOnline) return "ERROR: User already logged in";
+        string stored;
+        if (!users.read(username, [&](const User& user) { stored = user.password; })) {
+            return "ERROR: User not found";
+        }
         
-        // 檢查port衝突
-        for (const auto& pair : users) {
-            if (pair.second.isOnline && pair.second.clientPort == port && pair.first != username) {
-                return "ERROR: Port already in use";
+        shared_ptr<Connection> conn = ctx.conn;
+        ReplyRoute route = ctx.route;
+        string name(username);
+        // 舊帳號升級時還要用到明文；各個回呼只複製指標，最後一個參照釋放時清掉內容
+        shared_ptr<string> plain(new string(password), [](string* secret) {
+            OPENSSL_cleanse(&(*secret)[0], secret->size());
+            delete secret;
+        });
+        bool queued = passwordPool.verify(*plain, stored, [this, conn, route, name, port, plain](bool match, bool legacy) {
+            continueCommand(conn, route, [this, conn, name, port, plain, match, legacy]() {
+                if (!match) return string("ERROR: Wrong password");
+                if (legacy) upgradePassword(name, *plain);
+                
+                string result = handleLogin(name, conn->getIP(), port, conn->getId(), conn->getFd());
+                if (result == "LOGIN_SUCCESS") {
+                    // 連線暫停處理指令中，只有這裡會改 currentUser
+                    conn->currentUser = name;
+                    // 儲存連線映射
+                    lock_guard<shared_mutex> lock(sockets_mutex);
+                    userSockets[conn->currentUser] = conn;
+                }
+                return result;
+            });
+        });
+        if (!queued) return "ERROR: Server busy, try again later";
+        ctx.suspended = true;
+        return "";
+    }
+    
+    // 舊的明文密碼在下次登入成功時改存雜湊 (背景進行，不影響這次登入)
+    void upgradePassword(const string& username, const string& password) {
+        passwordPool.hash(password, [this, username](string encoded) {
+            if (encoded.empty()) return;
+            try {
+                thread_pool.post(TaskPriority::Bulk, [this, username, encoded]() {
+                    users.update(username, [&](User& user) { user.password = encoded; });
+                    userStore.logSetPassword(username, encoded, [username](bool ok) {
+                        if (!ok) LOG_ERROR("⚠️ Failed to persist password upgrade for " << username);
+                    });
+                });
+            } catch (const exception& e) {
+                LOG_ERROR("Failed to enqueue password upgrade: " << e.what());
             }
+        });
+    }
+    
+    string commandLogout(CommandContext& ctx, CommandTokenizer&) {
+        string result = handleLogout(ctx.currentUser, ctx.clientId);
+        if (result == "LOGOUT_SUCCESS") {
+            leaveAllRooms(ctx.currentUser);
+            lock_guard<shared_mutex> lock(sockets_mutex);
+            userSockets.erase(ctx.currentUser);
+            ctx.currentUser = "";
+        }
+        return result;
+    }
+    
+    string commandList(CommandContext& ctx, CommandTokenizer& args) {
+        return handleListUsers(args, ctx.clientId);
+    }
+    
+    string commandMessage(CommandContext& ctx, CommandTokenizer& args) {
+        return handleMessage(ctx.currentUser, args.rest(), ctx.clientId);
+    }
+    
+    string commandGetUserInfo(CommandContext& ctx, CommandTokenizer& args) {
+        return handleGetUserInfo(args.next(), ctx.currentUser, ctx.clientId);
+    }
+    
+    string commandEncryptionStatus(CommandContext&, CommandTokenizer&) {
+        return encryptionEnabled ? "ENCRYPTION_STATUS:ENABLED:AES-256-CBC" : "ENCRYPTION_STATUS:DISABLED";
+    }
+    
+    // ========== 群組聊天命令 ==========
+    
+    string commandCreateRoom(CommandContext& ctx, CommandTokenizer& args) {
+        return handleCreateRoom(args.next(), ctx.currentUser, ctx.clientId);
+    }
+    
+    string commandJoinRoom(CommandContext& ctx, CommandTokenizer& args) {
+        return handleJoinRoom(args.next(), ctx.currentUser, ctx.clientId);
+    }
+    
+    string commandLeaveRoom(CommandContext& ctx, CommandTokenizer& args) {
+        return handleLeaveRoom(args.next(), ctx.currentUser, ctx.clientId);
+    }
+    
+    string commandListRooms(CommandContext& ctx, CommandTokenizer& args) {
+        return handleListRooms(args, ctx.clientId);
+    }
+    
+    string commandRoomMembers(CommandContext& ctx, CommandTokenizer& args) {
+        return handleRoomMembers(args.next(), ctx.currentUser, ctx.clientId);
+    }
+    
+    string commandRoomMsg(CommandContext& ctx, CommandTokenizer& args) {
+        string_view roomName = args.next();
+        string_view msg = args.rest();
+        // 去除前導空格
+        if (!msg.empty() && msg[0] == ' ') msg.remove_prefix(1);
+        return handleRoomMessage(roomName, ctx.currentUser, msg, ctx.clientId);
+    }
+    
+    string commandRoomHistory(CommandContext& ctx, CommandTokenizer& args) {
+        string_view roomName = args.next();
+        string_view beforeArg = args.next();
+        string_view limitArg = args.next();
+        if (beforeArg.empty()) {
+            return handleRoomHistory(roomName, ctx.currentUser, ctx.clientId);
         }
         
-        it->second.isOnline = true;
-        it->second.clientIP = clientIP;
-        it->second.clientPort = port;
-        it->second.clientSocket = clientSocket;
+        // ROOM_HISTORY <room> <before_seq> [<limit>]
+        uint64_t beforeSeq = 0;
+        size_t limit = 20;
+        if (!CommandParser::parseInt(beforeArg, beforeSeq) ||
+            (!limitArg.empty() && !CommandParser::parseInt(limitArg, limit))) {
+            return "ERROR: Invalid history cursor";
+        }
+        return handleRoomHistoryPage(roomName, ctx.currentUser, beforeSeq, limit);
+    }
+    
+    // ========== 基本用戶管理 ==========
+    
+    // passwordHash: PasswordPool 產生的 scrypt 雜湊
+    // 成功佔用名稱時回傳空字串，落盤後由 continueCommand 回覆
+    string handleRegister(const shared_ptr<Connection>& conn, const ReplyRoute& route,
+                          const string& username, const string& passwordHash) {
+        User user{username, passwordHash};
+        if (!users.insert(user)) {
+            return "ERROR: Username already exists";
+        }
+        
+        // 先佔用名稱再寫 WAL，等到落盤 (group commit) 才回覆成功；
+        // worker 不等待 fsync，由 committer 完成後排回 ThreadPool
+        userStore.logRegister(user.username, user.password, [this, conn, route, username](bool ok) {
+            continueCommand(conn, route, [this, conn, username, ok]() {
+                if (!ok) {
+                    users.erase(username);
+                    LOG_ERROR("[Client " << conn->getId() << "] Failed to persist registration: " << username);
+                    return string("ERROR: Registration failed");
+                }
+                LOG_INFO("[Client " << conn->getId() << "] Registered: " << username);
+                return string("REGISTER_SUCCESS");
+            });
+        });
+        return "";
+    }
+    
+    // 密碼已由密碼池驗證通過
+    string handleLogin(const string& username, const string& clientIP, 
+                      int port, int clientId, int clientSocket) {
+        // 上線檢查與端點衝突檢查 (只看上線中的用戶)
+        switch (onlineUsers.claim(username, clientIP, port)) {
+        case OnlineIndex::ClaimResult::AlreadyOnline:
+            return "ERROR: User already logged in";
+        case OnlineIndex::ClaimResult::EndpointInUse:
+            return "ERROR: Port already in use";
+        case OnlineIndex::ClaimResult::Ok:
+            break;
+        }
+        userDirectory.invalidate();
+        
+        users.update(username, [&](User& user) {
+            user.isOnline = true;
+            user.clientIP = clientIP;
+            user.clientPort = port;
+            user.clientSocket = clientSocket;
+        });
         
-        cout << "[Client " << clientId << "] Login: " << username << " (" << clientIP << ":" << port << ")" << endl;
+        LOG_INFO("[Client " << clientId << "] Login: " << username << " (" << clientIP << ":" << port << ")");
         return "LOGIN_SUCCESS";
     }
     
     string handleLogout(const string& username, int clientId) {
         if (username.empty()) return "ERROR: Not logged in";
         
-        lock_guard<mutex> lock(users_mutex);
-        auto it = users.find(username);
-        if (it != users.end()) {
-            it->second.isOnline = false;
-            it->second.clientIP = "";
-            it->second.clientPort = 0;
-            it->second.clientSocket = -1;
+        users.update(username, [](User& user) {
+            user.isOnline = false;
+            user.clientIP = "";
+            user.clientPort = 0;
+            user.clientSocket = -1;
+        });
+        if (onlineUsers.release(username)) {
+            userDirectory.invalidate();
         }
         
-        cout << "[Client " << clientId << "] Logout: " << username << endl;
+        LOG_INFO("[Client " << clientId << "] Logout: " << username);
         return "LOGOUT_SUCCESS";
     }
     
-    string handleListUsers(int clientId) {
-        lock_guard<mutex> lock(users_mutex);
-        
-        string result = "ONLINE_USERS:";
-        bool hasOnline = false;
-        
-        for (const auto& pair : users) {
-            if (pair.second.isOnline) {
-                result += " " + pair.first + "(" + pair.second.clientIP + ":" + 
-                         to_string(pair.second.clientPort) + ")";
-                hasOnline = true;
-            }
+    string handleListUsers(CommandTokenizer& args, int clientId) {
+        auto snapshot = userDirectory.get([this](vector<DirectoryCache::Entry>& entries) {
+            onlineUsers.forEach([&](const string& username, const OnlineIndex::Endpoint& endpoint) {
+                entries.push_back({username, username + "(" + endpoint.ip + ":" + to_string(endpoint.port) + ")"});
+            });
+        });
+        return directoryResponse(userDirectory, *snapshot, args);
+    }
+    
+    // LIST / LIST_ROOMS 共用：沒有版本參數時回傳舊格式完整清單
+    static string directoryResponse(const DirectoryCache& cache, const DirectoryCache::Snapshot& snapshot,
+                                    CommandTokenizer& args) {
+        string_view versionArg = args.next();
+        if (versionArg.empty()) {
+            return snapshot.fullResponse;
         }
         
-        return hasOnline ? result : "No users online";
+        uint64_t knownVersion = 0;
+        if (!CommandParser::parseInt(versionArg, knownVersion)) {
+            return "ERROR: Invalid directory version";
+        }
+        return cache.page(snapshot, knownVersion, args.next());
     }
     
-    string handleMessage(const string& sender, const string& message, int clientId) {
+    string handleMessage(const string& sender, string_view message, int clientId) {
         if (sender.empty()) return "ERROR: Not logged in";
-        cout << "[Client " << clientId << "] Message from " << sender << ":" << message << endl;
+        LOG_SAMPLED(LogLevel::Info, 20, "[Client " << clientId << "] Message from " << sender << ":" << message);
         return "MESSAGE_RECEIVED";
     }
     
-    string handleGetUserInfo(const string& targetUser, const string& requester, int clientId) {
+    string handleGetUserInfo(string_view targetUser, const string& requester, int clientId) {
         if (requester.empty()) return "ERROR: Not logged in";
         if (targetUser.empty()) return "ERROR: Target username cannot be empty";
         
-        lock_guard<mutex> lock(users_mutex);
-        auto it = users.find(targetUser);
-        if (it == users.end()) return "ERROR: User not found";
-        if (!it->second.isOnline) return "ERROR: User not online";
+        OnlineIndex::Endpoint endpoint;
+        if (onlineUsers.lookup(targetUser, endpoint)) {
+            return "USER_INFO:" + endpoint.ip + ":" + to_string(endpoint.port);
+        }
         
-        return "USER_INFO:" + it->second.clientIP + ":" + to_string(it->second.clientPort);
+        return users.read(targetUser, [](const User&) {}) ? "ERROR: User not online" : "ERROR: User not found";
     }
     
     // ========== 群組聊天功能 ==========
     
-    string handleCreateRoom(const string& roomName, const string& creator, int clientId) {
+    // 查詢房間 handle (只在查表時持有 rooms_mutex)
+    shared_ptr<ChatRoom> findRoom(string_view roomName) const {
+        shared_lock<shared_mutex> lock(rooms_mutex);
+        auto it = chatRooms.find(roomName);
+        return it == chatRooms.end() ? nullptr : it->second;
+    }
+    
+    string handleCreateRoom(string_view roomName, const string& creator, int clientId) {
         if (creator.empty()) return "ERROR: Not logged in";
         if (roomName.empty()) return "ERROR: Room name cannot be empty";
         
-        lock_guard<mutex> lock(rooms_mutex);
-        
-        if (chatRooms.find(roomName) != chatRooms.end()) {
-            return "ERROR: Room already exists";
+        string name(roomName);
+        {
+            lock_guard<shared_mutex> lock(rooms_mutex);
+            if (chatRooms.find(name) != chatRooms.end() || openingRooms.find(name) != openingRooms.end()) {
+                return "ERROR: Room already exists";
+            }
+            openingRooms.insert(name);
         }
-        
-        chatRooms[roomName] = ChatRoom(roomName, creator);
-        cout << "[Client " << clientId << "] Created room: " << roomName << " by " << creator << endl;
-        return "ROOM_CREATED:" + roomName;
+        // 名稱已保留，同一個房間目錄只有一個寫入者；開檔與掃描 segment 不持有表鎖，
+        // 不會擋住其他連線的 findRoom
+        auto room = make_shared<ChatRoom>(name, creator, historyMaxMessages, historyMaxBytes,
+                                          historyStore.openRoom(name, creator));
+        {
+            lock_guard<shared_mutex> lock(rooms_mutex);
+            openingRooms.erase(name);
+            chatRooms.emplace(name, move(room));
+        }
+        roomDirectory.invalidate();
+        LOG_INFO("[Client " << clientId << "] Created room: " << name << " by " << creator);
+        return "ROOM_CREATED:" + name;
     }
     
-    string handleJoinRoom(const string& roomName, const string& username, int clientId) {
+    string handleJoinRoom(string_view roomName, const string& username, int clientId) {
         if (username.empty()) return "ERROR: Not logged in";
         if (roomName.empty()) return "ERROR: Room name cannot be empty";
         
-        lock_guard<mutex> lock(rooms_mutex);
-        
-        auto it = chatRooms.find(roomName);
-        if (it == chatRooms.end()) {
+        shared_ptr<ChatRoom> room = findRoom(roomName);
+        if (!room) {
             return "ERROR: Room not found";
         }
         
-        lock_guard<mutex> roomLock(*it->second.room_mutex);
-        
-        if (it->second.members.find(username) != it->second.members.end()) {
-            return "ERROR: Already in room";
+        vector<string> recipients;
+        {
+            lock_guard<mutex> roomLock(room->room_mutex);
+            if (!room->members.insert(username).second) {
+                return "ERROR: Already in room";
+            }
+            recipients = memberSnapshot(*room, username);
         }
+        roomDirectory.invalidate();
         
-        it->second.members.insert(username);
-        
-        // 通知其他成員
-        broadcastToRoom(roomName, "ROOM_NOTIFICATION:" + roomName + ":" + username + " joined the room", username);
+        // 通知其他成員 (已釋放所有鎖)
+        broadcastToRoom(recipients, "ROOM_NOTIFICATION:" + room->roomName + ":" + username + " joined the room");
         
-        cout << "[Client " << clientId << "] " << username << " joined room: " << roomName << endl;
-        return "ROOM_JOINED:" + roomName;
+        LOG_INFO("[Client " << clientId << "] " << username << " joined room: " << room->roomName);
+        return "ROOM_JOINED:" + room->roomName;
     }
     
-    string handleLeaveRoom(const string& roomName, const string& username, int clientId) {
+    string handleLeaveRoom(string_view roomName, const string& username, int clientId) {
         if (username.empty()) return "ERROR: Not logged in";
         if (roomName.empty()) return "ERROR: Room name cannot be empty";
         
-        lock_guard<mutex> lock(rooms_mutex);
-        
-        auto it = chatRooms.find(roomName);
-        if (it == chatRooms.end()) {
+        shared_ptr<ChatRoom> room = findRoom(roomName);
+        if (!room) {
             return "ERROR: Room not found";
         }
         
-        lock_guard<mutex> roomLock(*it->second.room_mutex);
-        
-        if (it->second.members.find(username) == it->second.members.end()) {
-            return "ERROR: Not in room";
+        vector<string> recipients;
+        {
+            lock_guard<mutex> roomLock(room->room_mutex);
+            if (room->members.erase(username) == 0) {
+                return "ERROR: Not in room";
+            }
+            recipients = memberSnapshot(*room, username);
         }
+        roomDirectory.invalidate();
         
-        it->second.members.erase(username);
+        // 通知其他成員 (已釋放所有鎖)
+        broadcastToRoom(recipients, "ROOM_NOTIFICATION:" + room->roomName + ":" + username + " left the room");
         
-        // 通知其他成員
-        broadcastToRoom(roomName, "ROOM_NOTIFICATION:" + roomName + ":" + username + " left the room", username);
-        
-        cout << "[Client " << clientId << "] " << username << " left room: " << roomName << endl;
-        return "ROOM_LEFT:" + roomName;
+        LOG_INFO("[Client " << clientId << "] " << username << " left room: " << room->roomName);
+        return "ROOM_LEFT:" + room->roomName;
     }
     
-    string handleListRooms(int clientId) {
-        lock_guard<mutex> lock(rooms_mutex);
-        
-        if (chatRooms.empty()) {
-            return "No rooms available";
-        }
-        
-        string result = "ROOMS:";
-        for (const auto& pair : chatRooms) {
-            result += " " + pair.first + "(" + to_string(pair.second.members.size()) + " members)";
-        }
-        
-        return result;
+    string handleListRooms(CommandTokenizer& args, int clientId) {
+        auto snapshot = roomDirectory.get([this](vector<DirectoryCache::Entry>& entries) {
+            for (const auto& room : roomSnapshot()) {
+                lock_guard<mutex> roomLock(room->room_mutex);
+                entries.push_back({room->roomName, room->roomName + "(" + to_string(room->members.size()) + " members)"});
+            }
+        });
+        return directoryResponse(roomDirectory, *snapshot, args);
     }
     
-    string handleRoomMembers(const string& roomName, const string& username, int clientId) {
+    string handleRoomMembers(string_view roomName, const string& username, int clientId) {
         if (username.empty()) return "ERROR: Not logged in";
         
-        lock_guard<mutex> lock(rooms_mutex);
-        
-        auto it = chatRooms.find(roomName);
-        if (it == chatRooms.end()) {
+        shared_ptr<ChatRoom> room = findRoom(roomName);
+        if (!room) {
             return "ERROR: Room not found";
         }
         
-        lock_guard<mutex> roomLock(*it->second.room_mutex);
+        lock_guard<mutex> roomLock(room->room_mutex);
         
-        if (it->second.members.find(username) == it->second.members.end()) {
+        if (room->members.find(username) == room->members.end()) {
             return "ERROR: Not in room";
         }
         
-        string result = "ROOM_MEMBERS:" + roomName + ":";
-        for (const string& member : it->second.members) {
+        string result = "ROOM_MEMBERS:" + room->roomName + ":";
+        for (const string& member : room->members) {
             result += " " + member;
         }
         
         return result;
     }
     
-    string handleRoomMessage(const string& roomName, const string& sender, const string& message, int clientId) {
+    string handleRoomMessage(string_view roomName, const string& sender, string_view message, int clientId) {
         if (sender.empty()) return "ERROR: Not logged in";
         if (roomName.empty()) return "ERROR: Room name cannot be empty";
         if (message.empty()) return "ERROR: Message cannot be empty";
         
-        lock_guard<mutex> lock(rooms_mutex);
+        shared_ptr<ChatRoom> room = findRoom(roomName);
+        if (!room) {
+            return "ERROR: Room not found";
+        }
         
-        auto it = chatRooms.find(roomName);
-        if (it == chatRooms.end()) {
+        vector<string> recipients;
+        {
+            lock_guard<mutex> roomLock(room->room_mutex);
+            
+            if (room->members.find(sender) == room->members.end()) {
+                return "ERROR: Not in room";
+            }
+            
+            // 儲存訊息歷史
+            if (room->appendHistory(sender, message) == 0) {
+                LOG_SAMPLED(LogLevel::Error, 1, "⚠️ History write failed in room " << room->roomName);
+            }
+            recipients = memberSnapshot(*room, "");
+        }
+        
+        // 廣播訊息給所有成員（包括發送者，讓他知道訊息已發送），已釋放所有鎖
+        string broadcastMsg = "ROOM_MSG:" + room->roomName + ":" + sender + ":";
+        broadcastMsg.append(message);
+        broadcastToRoom(recipients, broadcastMsg);
+        
+        LOG_SAMPLED(LogLevel::Info, 20, "[Client " << clientId << "] Room message in " << room->roomName << " from " << sender);
+        return "ROOM_MSG_SENT";
+    }
+    
+    string handleRoomHistory(string_view roomName, const string& username, int clientId) {
+        if (username.empty()) return "ERROR: Not logged in";
+        
+        shared_ptr<ChatRoom> room = findRoom(roomName);
+        if (!room) {
             return "ERROR: Room not found";
         }
         
-        lock_guard<mutex> roomLock(*it->second.room_mutex);
+        lock_guard<mutex> roomLock(room->room_mutex);
         
-        if (it->second.members.find(sender) == it->second.members.end()) {
+        if (room->members.find(username) == room->members.end()) {
             return "ERROR: Not in room";
         }
         
-        // 儲存訊息歷史
-        it->second.messageHistory.push_back({sender, message});
+        if (room->historyEmpty()) {
+            return "ROOM_HISTORY:" + room->roomName + ":No messages";
+        }
         
-        // 廣播訊息給所有成員（包括發送者，讓他知道訊息已發送）
-        string broadcastMsg = "ROOM_MSG:" + roomName + ":" + sender + ":" + message;
-        broadcastToRoom(roomName, broadcastMsg, "");  // 空字串表示發給所有人
+        string result = "ROOM_HISTORY:" + room->roomName + ":";
+        // 只返回最後 20 條訊息
+        room->pageHistory(0, 20, [&](uint64_t, string_view sender, string_view text) {
+            result += "\n  [";
+            result += sender;
+            result += "]: ";
+            result += text;
+        });
         
-        cout << "[Client " << clientId << "] Room message in " << roomName << " from " << sender << endl;
-        return "ROOM_MSG_SENT";
+        return result;
     }
     
-    string handleRoomHistory(const string& roomName, const string& username, int clientId) {
+    // 往回分頁：回傳 seq < beforeSeq 的最後 limit 則 (beforeSeq 為 0 表示從最新開始)
+    // 格式: ROOM_HISTORY:<room>:<下一頁的 before_seq|END>:\n  #<seq> [sender]: message ...
+    string handleRoomHistoryPage(string_view roomName, const string& username, uint64_t beforeSeq,
+                                 size_t limit) {
         if (username.empty()) return "ERROR: Not logged in";
+        if (limit == 0 || limit > MAX_HISTORY_PAGE) limit = MAX_HISTORY_PAGE;
         
-        lock_guard<mutex> lock(rooms_mutex);
-        
-        auto it = chatRooms.find(roomName);
-        if (it == chatRooms.end()) {
+        shared_ptr<ChatRoom> room = findRoom(roomName);
+        if (!room) {
             return "ERROR: Room not found";
         }
         
-        lock_guard<mutex> roomLock(*it->second.room_mutex);
+        lock_guard<mutex> roomLock(room->room_mutex);
         
-        if (it->second.members.find(username) == it->second.members.end()) {
+        if (room->members.find(username) == room->members.end()) {
             return "ERROR: Not in room";
         }
         
-        if (it->second.messageHistory.empty()) {
-            return "ROOM_HISTORY:" + roomName + ":No messages";
+        string lines;
+        uint64_t firstSeq = 0;
+        room->pageHistory(beforeSeq, limit, [&](uint64_t seq, string_view sender, string_view text) {
+            if (firstSeq == 0) firstSeq = seq;
+            lines += "\n  #" + to_string(seq) + " [";
+            lines += sender;
+            lines += "]: ";
+            lines += text;
+        });
+        
+        bool hasOlder = firstSeq > room->oldestHistorySeq();
+        string next = hasOlder ? to_string(firstSeq) : "END";
+        return "ROOM_HISTORY:" + room->roomName + ":" + next + ":" + lines;
+    }
+    
+    // 環境變數設定的大小上限，未設定或格式錯誤時使用預設值
+    static size_t envSize(const char* name, size_t defaultValue) {
+        const char* value = getenv(name);
+        size_t parsed = 0;
+        if (value != nullptr && CommandParser::parseInt(string_view(value), parsed) && parsed > 0) {
+            return parsed;
+        }
+        return defaultValue;
+    }
+    
+    // CHAT_SCHEDULER=shared|steal
+    static SchedulerKind envScheduler() {
+        SchedulerKind kind = SchedulerKind::SharedQueue;
+        const char* value = getenv("CHAT_SCHEDULER");
+        if (value != nullptr && !ThreadPool::parseScheduler(value, kind)) {
+            LOG_WARN("⚠️ Unknown CHAT_SCHEDULER '" << value << "', using shared queue");
+        }
+        return kind;
+    }
+    
+    // Worker 數量範圍與調整門檻 (CHAT_POOL_MIN == CHAT_POOL_MAX 時為固定大小)
+    static ThreadPoolSizing envPoolSizing() {
+        ThreadPoolSizing sizing;
+        sizing.minThreads = envSize("CHAT_POOL_MIN", 4);
+        sizing.maxThreads = envSize("CHAT_POOL_MAX", 64);
+        sizing.spawnWait = chrono::microseconds(envSize("CHAT_POOL_SPAWN_WAIT_US", 2000));
+        sizing.keepAlive = chrono::milliseconds(envSize("CHAT_POOL_KEEPALIVE_MS", 30000));
+        if (sizing.maxThreads < sizing.minThreads) {
+            LOG_WARN("⚠️ CHAT_POOL_MAX < CHAT_POOL_MIN, using fixed " << sizing.minThreads << " workers");
+        }
+        return sizing;
+    }
+    
+    // CPU 配置：
+    //   CHAT_NUMA_NODE=<n>      事件迴圈與 worker 都限制在該 NUMA 節點的 CPU
+    //   CHAT_IO_CPUS=<list>     保留給事件迴圈的核心 (每個事件迴圈固定一個)，worker 不使用
+    //   CHAT_WORKER_CPUS=<list> worker 可用的核心 (預設為剩下的全部)
+    //   CHAT_WORKER_PIN=core    每個 worker 固定一個核心；set (預設) 則在整組核心內浮動
+    // 都沒設定時 worker 不限制，事件迴圈只有在啟動參數 pin 時逐一固定 (與之前相同)
+    static CpuPlan envCpuPlan(bool pinReactors) {
+        CpuPlan plan;
+        vector<int> base = CpuTopology::allowedCpus();
+        const char* node = getenv("CHAT_NUMA_NODE");
+        const char* io = getenv("CHAT_IO_CPUS");
+        const char* workerList = getenv("CHAT_WORKER_CPUS");
+        const char* pinMode = getenv("CHAT_WORKER_PIN");
+        
+        bool nodeBound = false;
+        int nodeId = 0;
+        if (node != nullptr) {
+            vector<int> nodeCpus;
+            if (CommandParser::parseInt(string_view(node), nodeId)) {
+                nodeCpus = CpuTopology::intersect(CpuTopology::nodeCpus(nodeId), base);
+            }
+            if (nodeCpus.empty()) {
+                LOG_WARN("⚠️ CHAT_NUMA_NODE '" << node << "' has no usable CPUs, ignoring");
+            } else {
+                base = nodeCpus;
+                nodeBound = true;
+                LOG_INFO("NUMA node " << nodeId << ": CPUs " << CpuTopology::formatList(base));
+            }
         }
         
-        string result = "ROOM_HISTORY:" + roomName + ":";
-        // 只返回最後 20 條訊息
-        size_t start = it->second.messageHistory.size() > 20 ? it->second.messageHistory.size() - 20 : 0;
-        for (size_t i = start; i < it->second.messageHistory.size(); ++i) {
-            result += "\n  [" + it->second.messageHistory[i].first + "]: " + 
-                     it->second.messageHistory[i].second;
+        vector<int> ioCpus;
+        if (io != nullptr) {
+            if (!CpuTopology::parseList(io, ioCpus) || (ioCpus = CpuTopology::intersect(ioCpus, base)).empty()) {
+                LOG_WARN("⚠️ CHAT_IO_CPUS '" << io << "' has no usable CPUs, ignoring");
+                ioCpus.clear();
+            }
         }
         
-        return result;
+        if (!ioCpus.empty()) {
+            plan.reactors.cpus = ioCpus;
+            plan.reactors.perThread = true;
+        } else if (pinReactors || nodeBound) {
+            plan.reactors.cpus = base;
+            plan.reactors.perThread = pinReactors;
+        }
+        
+        if (!nodeBound && ioCpus.empty() && workerList == nullptr && pinMode == nullptr) {
+            return plan;
+        }
+        vector<int> workerCpus = base;
+        if (workerList != nullptr) {
+            vector<int> requested;
+            if (CpuTopology::parseList(workerList, requested)) {
+                workerCpus = CpuTopology::intersect(requested, base);
+            } else {
+                LOG_WARN("⚠️ Invalid CHAT_WORKER_CPUS '" << workerList << "', using all CPUs");
+            }
+        }
+        workerCpus = CpuTopology::subtract(workerCpus, ioCpus);
+        if (workerCpus.empty()) {
+            LOG_WARN("⚠️ No usable CPUs left for workers (after CHAT_IO_CPUS), workers unpinned");
+            return plan;
+        }
+        plan.workers.cpus = workerCpus;
+        plan.workers.perThread = pinMode != nullptr && string(pinMode) == "core";
+        return plan;
     }
     
-    // 廣播訊息給群組成員
-    void broadcastToRoom(const string& roomName, const string& message, const string& excludeUser) {
-        // 需要在已經持有 rooms_mutex 的情況下調用
-        auto it = chatRooms.find(roomName);
-        if (it == chatRooms.end()) return;
+    // 未設定時使用預設值；設為空字串表示停用
+    static string envString(const char* name, const char* defaultValue) {
+        const char* value = getenv(name);
+        return value != nullptr ? string(value) : string(defaultValue);
+    }
+    
+    // 目前所有房間的 handle (走訪時不持有 rooms_mutex)
+    vector<shared_ptr<ChatRoom>> roomSnapshot() const {
+        shared_lock<shared_mutex> lock(rooms_mutex);
+        vector<shared_ptr<ChatRoom>> rooms;
+        rooms.reserve(chatRooms.size());
+        for (const auto& pair : chatRooms) {
+            rooms.push_back(pair.second);
+        }
+        return rooms;
+    }
+    
+    // 複製廣播對象 (需持有 room_mutex)
+    static vector<string> memberSnapshot(const ChatRoom& room, const string& excludeUser) {
+        vector<string> recipients;
+        recipients.reserve(room.members.size());
+        for (const string& member : room.members) {
+            if (member != excludeUser) recipients.push_back(member);
+        }
+        return recipients;
+    }
+    
+    // 廣播訊息給群組成員 (呼叫時不可持有 rooms_mutex 或 room_mutex)
+    void broadcastToRoom(const vector<string>& recipients, const string& message) {
+        if (recipients.empty()) return;
+        
+        // 整則廣播只加密、編碼一次，所有成員的輸出佇列共用同一個訊框
+        string encMsg = message;
+        if (encryptionEnabled) {
+            string encrypted = crypto.encryptMessage(message);
+            if (!encrypted.empty()) {
+                encMsg = encrypted;
+            }
+        }
+        SharedFrame frame = Protocol::encodeSharedFrame(encMsg);
         
-        lock_guard<mutex> sockLock(sockets_mutex);
+        shared_lock<shared_mutex> sockLock(sockets_mutex);
         
-        for (const string& member : it->second.members) {
-            if (member == excludeUser) continue;
-            
+        for (const string& member : recipients) {
             auto sockIt = userSockets.find(member);
-            if (sockIt != userSockets.end() && sockIt->second >= 0) {
-                // 注意：這裡使用非阻塞方式發送，避免死鎖
-                // 實際應用中可能需要更複雜的訊息佇列機制
-                string encMsg = message;
-                if (encryptionEnabled) {
-                    string encrypted = crypto.encryptMessage(message);
-                    if (!encrypted.empty()) {
-                        encMsg = encrypted;
-                    }
-                }
-                string msgToSend = encMsg + "\n";
-                send(sockIt->second, msgToSend.c_str(), msgToSend.length(), MSG_NOSIGNAL);
+            if (sockIt != userSockets.end()) {
+                // 只放入該成員的輸出佇列，由事件迴圈寫出；佇列滿時丟棄
+                sockIt->second->push(frame);
             }
         }
     }
     
     // 離開所有群組
     void leaveAllRooms(const string& username) {
-        lock_guard<mutex> lock(rooms_mutex);
-        
-        for (auto& pair : chatRooms) {
-            lock_guard<mutex> roomLock(*pair.second.room_mutex);
-            pair.second.members.erase(username);
+        for (const auto& room : roomSnapshot()) {
+            lock_guard<mutex> roomLock(room->room_mutex);
+            if (room->members.erase(username) > 0) {
+                roomDirectory.invalidate();
+            }
         }
     }
     
+    void runReactor(size_t index) {
+        const CpuPlacement& placement = cpuPlan.reactors;
+        if (placement.enabled()) {
+            if (placement.apply(index)) {
+                if (placement.perThread) {
+                    LOG_INFO("Reactor " << index << " pinned to CPU " << placement.cpus[index % placement.cpus.size()]);
+                } else {
+                    LOG_INFO("Reactor " << index << " bound to CPUs " << CpuTopology::formatList(placement.cpus));
+                }
+            } else {
+                LOG_INFO("Reactor " << index << " CPU pinning not available");
+            }
+        }
+        eventLoops[index]->run();
+    }
+    
     void run() {
-        cout << "\n=== Server Running ===" << endl;
-        cout << "Ready for connections..." << endl;
+        LOG_INFO("\n=== Server Running ===");
+        LOG_INFO("Ready for connections...");
         
-        while (true) {
-            struct sockaddr_in clientAddr;
-            socklen_t clientAddrLen = sizeof(clientAddr);
-            
-            int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
-            if (clientSocket < 0) {
-                perror("Accept failed");
-                continue;
+        statsThread = thread([this]() { this->reportStats(); });
+        
+        // 第 0 個事件迴圈在目前執行緒執行，其餘各自一個執行緒
+        for (size_t i = 1; i < eventLoops.size(); ++i) {
+            reactorThreads.emplace_back([this, i]() {
+                this->runReactor(i);
+            });
+        }
+        runReactor(0);
+        
+        for (thread& reactor : reactorThreads) {
+            if (reactor.joinable()) reactor.join();
+        }
+    }
+    
+    // 各事件迴圈丟棄的推播總數 (累計)
+    uint64_t droppedFrames() const {
+        uint64_t total = 0;
+        for (const auto& loop : eventLoops) {
+            total += loop->getDroppedFrames();
+        }
+        return total;
+    }
+    
+    // 每個區間一行：排隊時間 (分優先等級)、執行時間、各 worker 使用率、尖峰排隊數，
+    // 用來區分延遲是來自池子飽和 (排隊時間高) 還是指令本身 (執行時間高)
+    void reportStats() {
+        ThreadPoolStats previous = thread_pool.stats(true);
+        PasswordPool::Stats previousKdf = passwordPool.stats();
+        uint64_t previousDropped = droppedFrames();
+        unique_lock<mutex> lock(stats_mutex);
+        while (!statsWakeup.wait_for(lock, statsInterval, [this]() { return statsStopping; })) {
+            ThreadPoolStats current = thread_pool.stats(true);
+            PasswordPool::Stats kdf = passwordPool.stats();
+            ThreadPoolStats window = current.since(previous);
+            if (window.completed() > 0 || window.queued > 0) {
+                LOG_INFO("📊 ThreadPool: " << window.summary());
             }
             
-            string clientIP = inet_ntoa(clientAddr.sin_addr);
-            int clientId = ++clientCounter;
-            
-            cout << "[Client " << clientId << "] New connection from " << clientIP << endl;
+            uint64_t kdfDone = kdf.completed - previousKdf.completed;
+            if (kdfDone > 0 || kdf.rejected != previousKdf.rejected) {
+                LOG_INFO("📊 PasswordPool: done=" << kdfDone << " queued=" << kdf.queued
+                         << " rejected=" << (kdf.rejected - previousKdf.rejected)
+                         << " wait(us) mean=" << (kdf.totalWaitMicros - previousKdf.totalWaitMicros) / max<uint64_t>(kdfDone, 1)
+                         << " work(us) mean=" << (kdf.totalWorkMicros - previousKdf.totalWorkMicros) / max<uint64_t>(kdfDone, 1));
+            }
             
-            try {
-                thread_pool.enqueue([this, clientSocket, clientIP, clientId]() {
-                    this->handleClient(clientSocket, clientIP, clientId);
-                });
-            } catch (const exception& e) {
-                cout << "[Client " << clientId << "] Failed to enqueue: " << e.what() << endl;
-                close(clientSocket);
+            uint64_t dropped = droppedFrames();
+            if (dropped != previousDropped) {
+                LOG_INFO("📊 Backpressure: dropped " << (dropped - previousDropped)
+                         << " broadcast frames to slow clients");
             }
+            previous = std::move(current);
+            previousKdf = kdf;
+            previousDropped = dropped;
         }
     }
     
     ~ChatServer() {
-        if (serverSocket >= 0) {
-            close(serverSocket);
+        {
+            lock_guard<mutex> lock(stats_mutex);
+            statsStopping = true;
         }
+        statsWakeup.notify_all();
+        if (statsThread.joinable()) statsThread.join();
+        
+        for (auto& loop : eventLoops) {
+            loop->stop();
+        }
+        for (thread& reactor : reactorThreads) {
+            if (reactor.joinable()) reactor.join();
+        }
+        for (int listenSocket : listenSockets) {
+            close(listenSocket);
+        }
+        
+        // WAL 的完成回呼會排進 thread_pool，要在它解構前寫出剩餘紀錄並停止 committer
+        userStore.close();
     }
 };
 
 int main(int argc, char* argv[]) {
     int port = 8080;
+    int reactors = 1;
+    bool pin = false;
     
     if (argc > 1) {
         port = atoi(argv[1]);
         if (port <= 0) {
-            cout << "Invalid port number" << endl;
+            LOG_ERROR("Invalid port number");
             return 1;
         }
     }
     
-    cout << "=== Phase 2 Complete Server ===" << endl;
-    cout << "Starting on port " << port << endl;
+    // 用法: ./server_phase2 [port] [reactors] [pin]
+    if (argc > 2) {
+        reactors = atoi(argv[2]);
+        if (reactors <= 0) {
+            LOG_ERROR("Invalid reactor count");
+            return 1;
+        }
+    }
+    if (argc > 3) {
+        pin = string(argv[3]) == "pin";
+    }
+    
+    LOG_INFO("=== Phase 2 Complete Server ===");
+    LOG_INFO("Starting on port " << port);
     
-    ChatServer server(port);
+    ChatServer server(port, reactors, pin);
     
     if (!server.startServer()) {
         return 1;
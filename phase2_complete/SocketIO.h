@@ -0,0 +1,79 @@
+#ifndef SOCKET_IO_H
+#define SOCKET_IO_H
+
+#include <atomic>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/**
+ * Phase 2: 可讓出的阻塞式 socket I/O
+ *
+ * Protocol::sendFrame/recvFrame 與 P2P 的處理函式經由這裡呼叫 recv/send。
+ * - 沒有安裝 Waiter，或 Waiter::active() 為 false 時，就是一般的阻塞式 recv/send
+ * - active() 為 true (例如在 fiber 內) 時以 MSG_DONTWAIT 嘗試，不改變 fd 本身的阻塞模式；
+ *   EAGAIN 時呼叫 Waiter::wait 等待 fd 就緒 (fiber 讓出 carrier)，再重試
+ *
+ * Waiter 由 Fiber.h 的 FiberScheduler 安裝，這個標頭本身不依賴 ucontext/epoll。
+ */
+class SocketIO {
+public:
+    struct Waiter {
+        bool (*active)();                  // 目前的執行環境是否可以讓出
+        bool (*wait)(int fd, bool write);  // 等待 fd 可讀/可寫；失敗時回傳 false，errno 說明原因
+    };
+
+    // 整個行程共用一個 Waiter (waiter 必須一直有效)
+    static void installWaiter(const Waiter* waiter) {
+        waiterSlot().store(waiter, std::memory_order_release);
+    }
+
+    static ssize_t recv(int fd, void* buffer, size_t len, int flags) {
+        return transfer(fd, buffer, len, flags, false);
+    }
+
+    static ssize_t send(int fd, const void* buffer, size_t len, int flags) {
+        return transfer(fd, const_cast<void*>(buffer), len, flags, true);
+    }
+
+private:
+    static std::atomic<const Waiter*>& waiterSlot() {
+        static std::atomic<const Waiter*> slot{nullptr};
+        return slot;
+    }
+
+    __attribute__((noinline)) static ssize_t transfer(int fd, void* buffer, size_t len, int flags, bool write) {
+        const Waiter* waiter = waiterSlot().load(std::memory_order_acquire);
+        if (waiter == nullptr || !waiter->active()) {
+            return write ? ::send(fd, buffer, len, flags) : ::recv(fd, buffer, len, flags);
+        }
+        for (;;) {
+            int error = 0;
+            ssize_t n = attempt(fd, buffer, len, flags, write, error);
+            if (n >= 0 || (error != EAGAIN && error != EWOULDBLOCK && error != EINTR)) {
+                return finish(n, error);
+            }
+            if (error != EINTR && !waiter->wait(fd, write)) {
+                return finish(-1, lastError());
+            }
+        }
+    }
+
+    // errno 在 fiber 換到另一個 carrier 後是另一份，讀寫都放在不 inline 的函式裡重新取得
+    __attribute__((noinline)) static ssize_t attempt(int fd, void* buffer, size_t len, int flags,
+                                                     bool write, int& error) {
+        ssize_t n = write ? ::send(fd, buffer, len, flags | MSG_DONTWAIT)
+                          : ::recv(fd, buffer, len, flags | MSG_DONTWAIT);
+        error = n < 0 ? errno : 0;
+        return n;
+    }
+
+    __attribute__((noinline)) static int lastError() { return errno; }
+
+    __attribute__((noinline)) static ssize_t finish(ssize_t n, int error) {
+        if (n < 0) errno = error;
+        return n;
+    }
+};
+
+#endif // SOCKET_IO_H
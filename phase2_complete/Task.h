@@ -0,0 +1,230 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * Phase 2: 任務型別 (Small-buffer Task + Freelist)
+ *
+ * - Task：只能移動的 void() 可呼叫物件，48 bytes 以內的 callable 直接放在內建緩衝區，
+ *   不像 std::function 需要另外配置 (較大的 callable 才退回 heap)
+ * - TaskNode：Task 加上串列指標，ThreadPool 的共享佇列與工作竊取排程器都以它為排程單位
+ * - TaskNodePool：TaskNode 的回收池。每個執行緒有自己的快取，
+ *   快取空了/滿了才一次跟全域串列交換一批，穩定狀態下送出任務不需要配置記憶體
+ * - TaskPriority：任務的優先等級，排程器依等級分開排隊
+ */
+class Task {
+public:
+    static const size_t INLINE_SIZE = 48;
+
+    Task() noexcept : ops(nullptr) {}
+
+    template <typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f) : ops(nullptr) {
+        emplace(std::forward<F>(f));
+    }
+
+    Task(Task&& other) noexcept : ops(nullptr) {
+        moveFrom(other);
+    }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    template <typename F>
+    void emplace(F&& f) {
+        using Fn = typename std::decay<F>::type;
+        reset();
+        if constexpr (fitsInline<Fn>()) {
+            new (storage) Fn(std::forward<F>(f));
+            ops = &InlineOps<Fn>::table;
+        } else {
+            Fn* heap = new Fn(std::forward<F>(f));
+            new (storage) Fn*(heap);
+            ops = &HeapOps<Fn>::table;
+        }
+    }
+
+    void operator()() { ops->invoke(storage); }
+
+    explicit operator bool() const noexcept { return ops != nullptr; }
+
+    void reset() noexcept {
+        if (ops != nullptr) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+    // callable 是否能放進內建緩衝區 (移動時不能丟例外)
+    template <typename Fn>
+    static constexpr bool fitsInline() {
+        return sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src) noexcept;   // 移動後 src 已解構
+        void (*destroy)(void*) noexcept;
+    };
+
+    template <typename Fn>
+    struct InlineOps {
+        static void invoke(void* p) { (*static_cast<Fn*>(p))(); }
+        static void move(void* dst, void* src) noexcept {
+            new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        }
+        static void destroy(void* p) noexcept { static_cast<Fn*>(p)->~Fn(); }
+        static constexpr Ops table = {invoke, move, destroy};
+    };
+
+    template <typename Fn>
+    struct HeapOps {
+        static Fn*& pointer(void* p) { return *static_cast<Fn**>(p); }
+        static void invoke(void* p) { (*pointer(p))(); }
+        static void move(void* dst, void* src) noexcept { new (dst) Fn*(pointer(src)); }
+        static void destroy(void* p) noexcept { delete pointer(p); }
+        static constexpr Ops table = {invoke, move, destroy};
+    };
+
+    alignas(std::max_align_t) unsigned char storage[INLINE_SIZE];
+    const Ops* ops;
+
+    void moveFrom(Task& other) noexcept {
+        if (other.ops != nullptr) {
+            other.ops->move(storage, other.storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+    }
+};
+
+// 任務優先等級 (數值越小越優先)
+enum class TaskPriority : unsigned char {
+    High = 0,     // 延遲敏感：指令回覆、房間轉送
+    Normal = 1,   // 預設
+    Bulk = 2,     // 背景批次工作，同時最多佔用一半的 worker
+};
+
+static const size_t TASK_PRIORITY_COUNT = 3;
+
+// 排程單位 (next 供 injection queue 與共享佇列串接；queuedAt 供彈性調整判斷等待時間)
+struct TaskNode {
+    Task task;
+    std::atomic<TaskNode*> next;
+    std::chrono::steady_clock::time_point queuedAt;
+    TaskPriority priority;
+
+    TaskNode() : next(nullptr), priority(TaskPriority::Normal) {}
+};
+
+class TaskNodePool {
+public:
+    static const size_t CACHE_LIMIT = 128;     // 每個執行緒最多保留的節點
+    static const size_t BATCH = 64;            // 與全域串列一次交換的數量
+    static const size_t GLOBAL_LIMIT = 16384;  // 全域串列上限，超過的直接釋放
+
+    static TaskNode* acquire() {
+        Cache& cache = localCache();
+        if (cache.head == nullptr) {
+            global().take(cache);
+        }
+        TaskNode* node = cache.head;
+        if (node == nullptr) {
+            return new TaskNode();
+        }
+        cache.head = node->next.load(std::memory_order_relaxed);
+        --cache.count;
+        node->next.store(nullptr, std::memory_order_relaxed);
+        return node;
+    }
+
+    // 歸還節點 (會先清掉裡面的 callable)
+    static void release(TaskNode* node) {
+        node->task.reset();
+        Cache& cache = localCache();
+        if (cache.count >= CACHE_LIMIT) {
+            global().give(cache, BATCH);
+        }
+        node->next.store(cache.head, std::memory_order_relaxed);
+        cache.head = node;
+        ++cache.count;
+    }
+
+private:
+    struct Cache {
+        TaskNode* head = nullptr;
+        size_t count = 0;
+
+        // 執行緒結束時把快取交回全域串列
+        ~Cache() { global().give(*this, count); }
+    };
+
+    struct Global {
+        std::mutex mutex;
+        TaskNode* head = nullptr;
+        size_t count = 0;
+
+        void take(Cache& cache) {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (head != nullptr && cache.count < BATCH) {
+                TaskNode* node = head;
+                head = node->next.load(std::memory_order_relaxed);
+                --count;
+                node->next.store(cache.head, std::memory_order_relaxed);
+                cache.head = node;
+                ++cache.count;
+            }
+        }
+
+        void give(Cache& cache, size_t n) {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (n > 0 && cache.head != nullptr) {
+                TaskNode* node = cache.head;
+                cache.head = node->next.load(std::memory_order_relaxed);
+                --cache.count;
+                --n;
+                if (count >= GLOBAL_LIMIT) {
+                    delete node;
+                    continue;
+                }
+                node->next.store(head, std::memory_order_relaxed);
+                head = node;
+                ++count;
+            }
+        }
+    };
+
+    static Global& global() {
+        // 刻意不解構：執行緒的快取可能在靜態物件解構之後才交回
+        static Global* pool = new Global();
+        return *pool;
+    }
+
+    static Cache& localCache() {
+        thread_local Cache cache;
+        return cache;
+    }
+};
+
+#endif // TASK_H
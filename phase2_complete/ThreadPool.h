@@ -2,7 +2,6 @@
 #define THREAD_POOL_H
 
 #include <vector>
-#include <queue>
 #include <memory>
 #include <thread>
 #include <mutex>
@@ -10,77 +9,415 @@
 #include <future>
 #include <functional>
 #include <stdexcept>
-#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <exception>
+#include "Logger.h"
+#include "Task.h"
+#include "PoolStats.h"
+#include "CpuTopology.h"
+#include "WorkStealing.h"
+#include "Fiber.h"
+
+// 任務排程方式
+enum class SchedulerKind {
+    SharedQueue,   // 單一佇列 + mutex/condition variable (預設)
+    WorkStealing   // 每個 worker 一個 Chase-Lev deque + 無鎖 injection queue (WorkStealing.h)
+};
+
+// Worker 數量範圍 (minThreads == maxThreads 時為固定大小)
+// - 擴充：最舊的排隊任務等待超過 spawnWait 且沒有閒置 worker 時新增一個，
+//   兩次擴充至少間隔 spawnWait
+// - 縮減：worker 閒置超過 keepAlive 才退出，且最近 keepAlive 內沒有擴充過
+//   (擴充快、縮減慢，尖峰之間的空檔不會反覆建立/結束執行緒)
+struct ThreadPoolSizing {
+    size_t minThreads;
+    size_t maxThreads;
+    std::chrono::microseconds spawnWait;
+    std::chrono::milliseconds keepAlive;
+
+    static ThreadPoolSizing fixed(size_t threads) {
+        return ThreadPoolSizing{threads, threads, std::chrono::microseconds(2000), std::chrono::milliseconds(30000)};
+    }
+
+    bool elastic() const { return minThreads < maxThreads; }
+};
+
+// 等待一組任務完成 (可重複 add；計數歸零時叫醒所有 wait 的執行緒)
+// - done 只有最後一次 (計數歸零) 需要拿 lock，其餘是一個 CAS
+// - 歸零的遞減在 lock 內完成，wait 返回後即可安全地解構 WaitGroup
+// - 會阻塞執行緒：不要在 fiber 內 wait
+class WaitGroup {
+public:
+    WaitGroup() : pending(0) {}
+    WaitGroup(const WaitGroup&) = delete;
+    WaitGroup& operator=(const WaitGroup&) = delete;
+
+    void add(size_t n = 1) {
+        pending.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void done(size_t n = 1) {
+        size_t current = pending.load(std::memory_order_relaxed);
+        while (current != n) {
+            if (pending.compare_exchange_weak(current, current - n, std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.fetch_sub(n, std::memory_order_acq_rel) == n) {
+            zero.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        zero.wait(lock, [this] { return pending.load(std::memory_order_acquire) == 0; });
+    }
+
+    // 逾時回傳 false
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return zero.wait_for(lock, timeout, [this] { return pending.load(std::memory_order_acquire) == 0; });
+    }
+
+    size_t count() const { return pending.load(std::memory_order_acquire); }
+
+private:
+    std::atomic<size_t> pending;
+    std::mutex mutex;
+    std::condition_variable zero;
+};
 
 class ThreadPool {
 public:
-    ThreadPool(size_t threads = 10);
-    
+    ThreadPool(size_t threads = 10, SchedulerKind kind = SchedulerKind::SharedQueue);
+    // placement: worker 的 CPU 配置 (預設不限制)；逐核心固定時依 slot 編號選核心，
+    // 彈性模式下重新啟動的 worker 仍回到同一個核心
+    ThreadPool(const ThreadPoolSizing& sizing, SchedulerKind kind = SchedulerKind::SharedQueue,
+               const CpuPlacement& placement = CpuPlacement());
+
+    template<class F, class... Args>
+    auto enqueue(F&& f, Args&&... args)
+        -> std::future<typename std::result_of<F(Args...)>::type>;
+
+    // 指定優先等級 (未指定為 TaskPriority::Normal)
     template<class F, class... Args>
-    auto enqueue(F&& f, Args&&... args) 
+    auto enqueue(TaskPriority priority, F&& f, Args&&... args)
         -> std::future<typename std::result_of<F(Args...)>::type>;
-    
-    size_t getWorkerCount() const { return workers.size(); }
-    size_t getQueueSize() const { 
+
+    // 不需要結果時使用：沒有 future/packaged_task，小的 callable 不配置記憶體
+    // (例外只會被 worker 記錄下來)
+    template<class F>
+    void post(F&& f);
+    template<class F>
+    void post(TaskPriority priority, F&& f);
+
+    // 一次送出一批任務 (任何可走訪的 void() callable 容器；右值會被搬走)：
+    // 共享佇列只拿一次 queue_mutex，工作竊取模式一次串進 injection queue
+    // 傳入 group 時先 add(批次大小)，每個任務結束 (包含丟出例外) 後 done()
+    template<class Tasks>
+    void enqueue_bulk(Tasks&& tasks, TaskPriority priority = TaskPriority::Normal);
+    template<class Tasks>
+    void enqueue_bulk(Tasks&& tasks, WaitGroup& group, TaskPriority priority = TaskPriority::Normal);
+
+    // 把 [begin, end) 切成每塊 grain 個，fn(chunkBegin, chunkEnd) 平行執行，全部完成才返回
+    // - 呼叫端也一起認領區塊，只等其他執行緒手上正在跑的區塊，worker 內呼叫 (巢狀) 也不會卡死
+    // - 第一個例外在全部結束後於呼叫端重新丟出，之後尚未開始的區塊略過
+    // - 池子已停止時全部由呼叫端執行
+    template<class F>
+    void parallel_for(size_t begin, size_t end, size_t grain, F&& fn,
+                      TaskPriority priority = TaskPriority::Normal);
+
+    // Fiber 模式：會阻塞在 socket 上的循序處理函式 (一條連線一個) 以 fiber 執行，
+    // 等待 I/O 時讓出 carrier，少數執行緒即可同時服務大量連線 (見 Fiber.h)
+    // 第一次呼叫時才啟動 carrier 執行緒；shutdown 之後回傳 false
+    template<class F>
+    bool spawnFiber(F&& f) {
+        return fibers().spawn(std::forward<F>(f));
+    }
+    FiberScheduler& fibers();
+
+    // 目前的 worker 數 (彈性模式下會在 min/max 之間變動)
+    size_t getWorkerCount() const {
+        if (stealing) return stealing->workerCount();
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        return liveWorkers;
+    }
+    size_t getQueueSize() const {
+        if (stealing) return stealing->pending();
         std::unique_lock<std::mutex> lock(queue_mutex);
-        return tasks.size(); 
+        return queuedTasks;
+    }
+    SchedulerKind getScheduler() const {
+        return stealing ? SchedulerKind::WorkStealing : SchedulerKind::SharedQueue;
     }
-    
+    const ThreadPoolSizing& getSizing() const { return sizing; }
+    const CpuPlacement& getPlacement() const { return placement; }
+
+    // 排隊時間/執行時間直方圖與每個 worker 的使用率 (累計值，見 PoolStats.h)
+    // resetPeak: 讀取後把最大排隊數歸零，定期回報時得到每個區間的尖峰
+    ThreadPoolStats stats(bool resetPeak = false);
+
+    // "shared" / "steal" (例如環境變數 CHAT_SCHEDULER)
+    static bool parseScheduler(const std::string& name, SchedulerKind& kind) {
+        std::string lower(name);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        if (lower == "shared") kind = SchedulerKind::SharedQueue;
+        else if (lower == "steal" || lower == "work-stealing") kind = SchedulerKind::WorkStealing;
+        else return false;
+        return true;
+    }
+
+    static const char* schedulerName(SchedulerKind kind) {
+        return kind == SchedulerKind::WorkStealing ? "work-stealing" : "shared queue";
+    }
+
     ~ThreadPool();
 
 private:
-    // Worker threads
+    ThreadPoolSizing sizing;
+    CpuPlacement placement;
+
+    // 工作竊取模式時使用，共享佇列模式為 nullptr
+    std::unique_ptr<WorkStealingScheduler> stealing;
+
+    // Fiber 模式 (spawnFiber 第一次呼叫時建立)
+    std::once_flag fibersOnce;
+    std::unique_ptr<FiberScheduler> fiberScheduler;
+
+    // Worker threads (每個 slot 一條，退出的 worker 留下 slot 供下次擴充重用)
     std::vector< std::thread > workers;
-    // Task queue
-    std::queue< std::function<void()> > tasks;
-    
+    std::vector< size_t > freeSlots;
+    size_t liveWorkers = 0;
+    size_t idleWorkers = 0;
+    std::chrono::steady_clock::time_point lastGrow;
+    std::unique_ptr<WorkerStats[]> workerStats;   // 每個 slot 一份
+
+    // Task queue：每個優先等級一條 TaskNode 串成的 FIFO (queue_mutex 保護)
+    // 取任務時以平滑加權輪詢 (smooth weighted round-robin) 在非空的 lane 間輪流，
+    // High 大部分時間優先但不會讓 Normal/Bulk 餓死；Bulk 同時執行數有上限，
+    // 大量背景工作也不會佔滿 worker 讓延遲敏感的任務排隊
+    struct Lane {
+        TaskNode* head = nullptr;
+        TaskNode* tail = nullptr;
+        int credit = 0;
+    };
+    static constexpr int LANE_WEIGHTS[TASK_PRIORITY_COUNT] = {16, 4, 1};   // High : Normal : Bulk
+
+    Lane lanes[TASK_PRIORITY_COUNT];
+    size_t queuedTasks = 0;
+    size_t peakQueued = 0;
+    size_t bulkRunning = 0;
+
     // Synchronization
     mutable std::mutex queue_mutex;
     std::condition_variable condition;
     bool stop;
+
+    // 執行 f 時計數歸零的 WaitGroup 包裝
+    template<class Fn>
+    struct GroupTask {
+        Fn fn;
+        WaitGroup* group;
+
+        void operator()() {
+            struct Done {
+                WaitGroup* group;
+                ~Done() { group->done(); }
+            } done{group};
+            fn();
+        }
+    };
+
+    void submit(TaskNode* node);
+    void submitChain(TaskNode* first, TaskNode* last, size_t count);
+    template<class Make>
+    void submitBatch(size_t count, TaskPriority priority, Make&& make);
+    TaskNode* popTask();
+    void workerLoop(size_t slot);
+    void spawnWorker();
+    void maybeGrow(std::chrono::steady_clock::time_point now,
+                   std::chrono::steady_clock::time_point oldestQueued);
 };
 
 // Constructor: 建立指定數量的worker threads
-inline ThreadPool::ThreadPool(size_t threads) : stop(false) {
-    std::cout << "Creating ThreadPool with " << threads << " workers" << std::endl;
-    
-    for(size_t i = 0; i < threads; ++i) {
-        workers.emplace_back([this, i] {
-            std::cout << "Worker " << i << " started (thread ID: " 
-                      << std::this_thread::get_id() << ")" << std::endl;
-            
-            for(;;) {
-                std::function<void()> task;
-
-                {
-                    std::unique_lock<std::mutex> lock(this->queue_mutex);
-                    this->condition.wait(lock,
-                        [this]{ return this->stop || !this->tasks.empty(); });
-                    
-                    if(this->stop && this->tasks.empty())
-                        return;
-                    
-                    task = std::move(this->tasks.front());
-                    this->tasks.pop();
-                }
+inline ThreadPool::ThreadPool(size_t threads, SchedulerKind kind)
+    : ThreadPool(ThreadPoolSizing::fixed(threads), kind) {}
 
-                try {
-                    task();
-                } catch(const std::exception& e) {
-                    std::cerr << "Worker exception: " << e.what() << std::endl;
-                } catch(...) {
-                    std::cerr << "Worker unknown exception" << std::endl;
-                }
+inline ThreadPool::ThreadPool(const ThreadPoolSizing& requested, SchedulerKind kind,
+                              const CpuPlacement& placement)
+    : sizing(requested), placement(placement), stop(false) {
+    sizing.minThreads = std::max<size_t>(sizing.minThreads, 1);
+    sizing.maxThreads = std::max(sizing.maxThreads, sizing.minThreads);
+
+    if (sizing.elastic()) {
+        LOG_INFO("Creating ThreadPool with " << sizing.minThreads << "-" << sizing.maxThreads
+                 << " workers (" << schedulerName(kind) << ", spawn after "
+                 << sizing.spawnWait.count() << "us wait, keep-alive "
+                 << sizing.keepAlive.count() << "ms)");
+    } else {
+        LOG_INFO("Creating ThreadPool with " << sizing.minThreads << " workers (" << schedulerName(kind) << ")");
+    }
+    if (placement.enabled()) {
+        LOG_INFO("ThreadPool workers placed on " << placement.describe());
+    }
+
+    if (kind == SchedulerKind::WorkStealing) {
+        stealing.reset(new WorkStealingScheduler(sizing.minThreads, sizing.maxThreads,
+                                                 sizing.spawnWait, sizing.keepAlive, placement));
+        return;
+    }
+
+    workers.resize(sizing.maxThreads);
+    workerStats.reset(new WorkerStats[sizing.maxThreads]);
+    for (size_t slot = sizing.maxThreads; slot > 0; --slot) {
+        freeSlots.push_back(slot - 1);
+    }
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    lastGrow = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sizing.minThreads; ++i) {
+        spawnWorker();
+    }
+}
+
+// 需持有 queue_mutex；slot 上若有已退出的舊執行緒先 join (它退出後不再碰 queue_mutex)
+inline void ThreadPool::spawnWorker() {
+    size_t slot = freeSlots.back();
+    freeSlots.pop_back();
+    if (workers[slot].joinable()) {
+        workers[slot].join();
+    }
+    ++liveWorkers;
+    workers[slot] = std::thread([this, slot] { workerLoop(slot); });
+}
+
+// 需持有 queue_mutex
+inline void ThreadPool::maybeGrow(std::chrono::steady_clock::time_point now,
+                                  std::chrono::steady_clock::time_point oldestQueued) {
+    if (stop || idleWorkers > 0 || liveWorkers >= sizing.maxThreads) return;
+    if (now - oldestQueued < sizing.spawnWait || now - lastGrow < sizing.spawnWait) return;
+
+    lastGrow = now;
+    spawnWorker();
+    LOG_INFO("ThreadPool grew to " << liveWorkers << " workers (oldest task waited "
+             << std::chrono::duration_cast<std::chrono::microseconds>(now - oldestQueued).count()
+             << "us, " << queuedTasks << " queued)");
+}
+
+// 需持有 queue_mutex；沒有可執行的任務 (全空，或只剩達到上限的 Bulk) 時回傳 nullptr
+inline TaskNode* ThreadPool::popTask() {
+    size_t bulkLimit = std::max<size_t>(liveWorkers / 2, 1);
+    int best = -1;
+    int total = 0;
+    for (size_t i = 0; i < TASK_PRIORITY_COUNT; ++i) {
+        if (lanes[i].head == nullptr) continue;
+        if (i == (size_t)TaskPriority::Bulk && bulkRunning >= bulkLimit) continue;
+        lanes[i].credit += LANE_WEIGHTS[i];
+        total += LANE_WEIGHTS[i];
+        if (best < 0 || lanes[i].credit > lanes[best].credit) best = (int)i;
+    }
+    if (best < 0) return nullptr;
+
+    Lane& lane = lanes[best];
+    lane.credit -= total;
+    TaskNode* node = lane.head;
+    lane.head = node->next.load(std::memory_order_relaxed);
+    if (lane.head == nullptr) {
+        lane.tail = nullptr;
+        lane.credit = 0;
+    }
+    --queuedTasks;
+    if (node->priority == TaskPriority::Bulk) ++bulkRunning;
+    return node;
+}
+
+inline void ThreadPool::workerLoop(size_t slot) {
+    LOG_DEBUG("Worker " << slot << " started (thread ID: "
+              << std::this_thread::get_id() << ")");
+
+    if (!placement.apply(slot)) {
+        LOG_WARN("Worker " << slot << " CPU placement failed, running unpinned");
+    }
+    WorkerStats& stats = workerStats[slot];
+    stats.started(steadyNanos(std::chrono::steady_clock::now()));
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    for(;;) {
+        ++idleWorkers;
+        bool retire = false;
+        TaskNode* node;
+        while ((node = popTask()) == nullptr) {
+            if (stop && queuedTasks == 0) break;
+            if (!sizing.elastic()) {
+                condition.wait(lock);
+                continue;
             }
-        });
+            if (condition.wait_for(lock, sizing.keepAlive) == std::cv_status::timeout &&
+                !stop && queuedTasks == 0 && liveWorkers > sizing.minThreads &&
+                std::chrono::steady_clock::now() - lastGrow >= sizing.keepAlive) {
+                retire = true;
+                break;
+            }
+        }
+        --idleWorkers;
+
+        if (retire) {
+            stats.stopped(steadyNanos(std::chrono::steady_clock::now()));
+            --liveWorkers;
+            freeSlots.push_back(slot);
+            LOG_INFO("ThreadPool shrank to " << liveWorkers << " workers (idle "
+                     << sizing.keepAlive.count() << "ms)");
+            return;
+        }
+        if (node == nullptr) {
+            // 停止且佇列已空：叫醒等待 Bulk 名額的其他 worker 一起結束
+            stats.stopped(steadyNanos(std::chrono::steady_clock::now()));
+            condition.notify_all();
+            return;
+        }
+
+        // 後面還有任務在排隊：以這個任務的等待時間判斷是否該擴充 (Bulk 被限流的等待不算)
+        TaskPriority priority = node->priority;
+        bool bulk = priority == TaskPriority::Bulk;
+        auto start = std::chrono::steady_clock::now();
+        if (queuedTasks > 0 && !bulk && sizing.elastic()) {
+            maybeGrow(start, node->queuedAt);
+        }
+        lock.unlock();
+
+        try {
+            node->task();
+        } catch(const std::exception& e) {
+            LOG_ERROR("Worker exception: " << e.what());
+        } catch(...) {
+            LOG_ERROR("Worker unknown exception");
+        }
+        stats.record(priority, steadyNanos(node->queuedAt), steadyNanos(start),
+                     steadyNanos(std::chrono::steady_clock::now()));
+        TaskNodePool::release(node);
+
+        lock.lock();
+        if (bulk) --bulkRunning;
     }
 }
 
 // 將任務加入佇列
 template<class F, class... Args>
-auto ThreadPool::enqueue(F&& f, Args&&... args) 
+auto ThreadPool::enqueue(F&& f, Args&&... args)
     -> std::future<typename std::result_of<F(Args...)>::type> {
-    
+    return enqueue(TaskPriority::Normal, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template<class F, class... Args>
+auto ThreadPool::enqueue(TaskPriority priority, F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type> {
+
     using return_type = typename std::result_of<F(Args...)>::type;
 
     auto task = std::make_shared< std::packaged_task<return_type()> >(
@@ -88,6 +425,44 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
         );
 
     std::future<return_type> res = task->get_future();
+    post(priority, [task](){ (*task)(); });
+    return res;
+}
+
+template<class F>
+void ThreadPool::post(F&& f) {
+    post(TaskPriority::Normal, std::forward<F>(f));
+}
+
+template<class F>
+void ThreadPool::post(TaskPriority priority, F&& f) {
+    TaskNode* node = TaskNodePool::acquire();
+    node->priority = priority;
+    try {
+        // 建構 callable 也可能丟出例外 (heap 配置失敗、移動/複製建構子)，節點一樣要歸還
+        node->task.emplace(std::forward<F>(f));
+        submit(node);
+    } catch (...) {
+        TaskNodePool::release(node);
+        throw;
+    }
+}
+
+inline void ThreadPool::submit(TaskNode* node) {
+    submitChain(node, node, 1);
+}
+
+// 以 next 串好、優先等級相同的 count 個節點 (first..last) 一次加入佇列；失敗時節點由呼叫端歸還
+inline void ThreadPool::submitChain(TaskNode* first, TaskNode* last, size_t count) {
+    auto now = std::chrono::steady_clock::now();
+    for (TaskNode* node = first; node != last; node = node->next.load(std::memory_order_relaxed)) {
+        node->queuedAt = now;
+    }
+    last->queuedAt = now;
+    if (stealing) {
+        stealing->submitChain(first, last, count);
+        return;
+    }
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
 
@@ -95,26 +470,201 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
         if(stop)
             throw std::runtime_error("enqueue on stopped ThreadPool");
 
-        tasks.emplace([task](){ (*task)(); });
+        Lane& lane = lanes[(size_t)first->priority];
+        last->next.store(nullptr, std::memory_order_relaxed);
+        if (lane.tail != nullptr) {
+            lane.tail->next.store(first, std::memory_order_relaxed);
+        } else {
+            lane.head = first;
+        }
+        lane.tail = last;
+        queuedTasks += count;
+        peakQueued = std::max(peakQueued, queuedTasks);
+
+        if (sizing.elastic() && first->priority != TaskPriority::Bulk) {
+            maybeGrow(now, lane.head->queuedAt);
+        }
     }
-    condition.notify_one();
-    return res;
+    if (count > 1) {
+        condition.notify_all();
+    } else {
+        condition.notify_one();
+    }
+}
+
+// 取 count 個節點，make(i, task) 填入 callable 後串成一串送出；任何一步失敗都歸還全部節點
+template<class Make>
+void ThreadPool::submitBatch(size_t count, TaskPriority priority, Make&& make) {
+    if (count == 0) return;
+    TaskNode* first = nullptr;
+    TaskNode* last = nullptr;
+    try {
+        for (size_t i = 0; i < count; ++i) {
+            TaskNode* node = TaskNodePool::acquire();
+            node->priority = priority;
+            if (last != nullptr) {
+                last->next.store(node, std::memory_order_relaxed);
+            } else {
+                first = node;
+            }
+            last = node;
+            make(i, node->task);
+        }
+        submitChain(first, last, count);
+    } catch (...) {
+        while (first != nullptr) {
+            TaskNode* next = first == last ? nullptr : first->next.load(std::memory_order_relaxed);
+            TaskNodePool::release(first);
+            first = next;
+        }
+        throw;
+    }
+}
+
+template<class Tasks>
+void ThreadPool::enqueue_bulk(Tasks&& tasks, TaskPriority priority) {
+    auto it = std::begin(tasks);
+    submitBatch((size_t)std::distance(std::begin(tasks), std::end(tasks)), priority,
+                [&it](size_t, Task& task) {
+        if constexpr (std::is_lvalue_reference<Tasks>::value) {
+            task.emplace(*it);
+        } else {
+            task.emplace(std::move(*it));
+        }
+        ++it;
+    });
+}
+
+template<class Tasks>
+void ThreadPool::enqueue_bulk(Tasks&& tasks, WaitGroup& group, TaskPriority priority) {
+    using Fn = typename std::decay<decltype(*std::begin(tasks))>::type;
+    size_t count = (size_t)std::distance(std::begin(tasks), std::end(tasks));
+    auto it = std::begin(tasks);
+    group.add(count);
+    try {
+        submitBatch(count, priority, [&it, &group](size_t, Task& task) {
+            if constexpr (std::is_lvalue_reference<Tasks>::value) {
+                task.emplace(GroupTask<Fn>{*it, &group});
+            } else {
+                task.emplace(GroupTask<Fn>{std::move(*it), &group});
+            }
+            ++it;
+        });
+    } catch (...) {
+        group.done(count);
+        throw;
+    }
+}
+
+template<class F>
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, F&& fn, TaskPriority priority) {
+    if (begin >= end) return;
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (end - begin - 1) / grain + 1;
+    if (chunks == 1) {
+        fn(begin, end);
+        return;
+    }
+
+    // helper 任務可能在 parallel_for 返回後才開始跑，共用狀態以 shared_ptr 保存；
+    // fn 只在認領到區塊後才使用，而呼叫端會等所有區塊完成才返回
+    struct Range {
+        std::atomic<size_t> next{0};
+        size_t chunks, begin, end, grain;
+        typename std::remove_reference<F>::type* fn;
+        WaitGroup group;
+        std::atomic<bool> failed{false};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+
+        void run() {
+            size_t chunk;
+            while ((chunk = next.fetch_add(1, std::memory_order_relaxed)) < chunks) {
+                if (!failed.load(std::memory_order_relaxed)) {
+                    size_t lo = begin + chunk * grain;
+                    size_t hi = end - lo > grain ? lo + grain : end;
+                    try {
+                        (*fn)(lo, hi);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (!error) error = std::current_exception();
+                        failed.store(true, std::memory_order_relaxed);
+                    }
+                }
+                group.done();
+            }
+        }
+    };
+    auto range = std::make_shared<Range>();
+    range->chunks = chunks;
+    range->begin = begin;
+    range->end = end;
+    range->grain = grain;
+    range->fn = &fn;
+    range->group.add(chunks);
+
+    size_t helpers = std::min(chunks - 1, getWorkerCount());
+    try {
+        submitBatch(helpers, priority, [&range](size_t, Task& task) {
+            task.emplace([range]() { range->run(); });
+        });
+    } catch (...) {
+        // 送不出去 (已停止) 就全部自己跑
+    }
+    range->run();
+    range->group.wait();
+    if (range->error) {
+        std::rethrow_exception(range->error);
+    }
+}
+
+inline ThreadPoolStats ThreadPool::stats(bool resetPeak) {
+    ThreadPoolStats result;
+    if (stealing) {
+        stealing->collect(result, resetPeak);
+        return result;
+    }
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        result.workers = liveWorkers;
+        result.queued = queuedTasks;
+        result.peakQueued = peakQueued;
+        if (resetPeak) peakQueued = queuedTasks;
+    }
+    int64_t now = steadyNanos(std::chrono::steady_clock::now());
+    for (size_t slot = 0; slot < sizing.maxThreads; ++slot) {
+        result.collectWorker(slot, workerStats[slot], now);
+    }
+    return result;
+}
+
+inline FiberScheduler& ThreadPool::fibers() {
+    std::call_once(fibersOnce, [this] { fiberScheduler.reset(new FiberScheduler()); });
+    return *fiberScheduler;
 }
 
 // Destructor: 停止所有worker threads
 inline ThreadPool::~ThreadPool() {
-    std::cout << "Shutting down ThreadPool..." << std::endl;
+    LOG_INFO("Shutting down ThreadPool...");
+    // fiber 可能還會送出任務，先等它們結束
+    fiberScheduler.reset();
+    if (stealing) {
+        stealing.reset();  // 執行完剩餘任務後結束
+        LOG_INFO("ThreadPool shutdown complete");
+        return;
+    }
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
         stop = true;
     }
     condition.notify_all();
+    // stop 之後不會再擴充，workers 不再變動
     for(std::thread &worker: workers) {
         if(worker.joinable()) {
             worker.join();
         }
     }
-    std::cout << "ThreadPool shutdown complete" << std::endl;
+    LOG_INFO("ThreadPool shutdown complete");
 }
 
 #endif // THREAD_POOL_H
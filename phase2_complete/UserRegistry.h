@@ -0,0 +1,191 @@
+#ifndef USER_REGISTRY_H
+#define USER_REGISTRY_H
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+#include <mutex>
+#include <functional>
+
+struct User {
+    std::string username;
+    std::string password;
+    bool isOnline;
+    std::string clientIP;
+    int clientPort;
+    int clientSocket;  // 用於群組訊息推送
+
+    User() : isOnline(false), clientPort(0), clientSocket(-1) {}
+    User(std::string user, std::string pass) : username(user), password(pass), isOnline(false), clientPort(0), clientSocket(-1) {}
+};
+
+/**
+ * Phase 2: 分片用戶表 (Sharded User Registry)
+ *
+ * - 依 username 的 hash 分到 SHARD_COUNT 個分片，每個分片有自己的讀寫鎖
+ * - 查詢 (GET_USER_INFO 等) 只取共享鎖，不同分片之間完全不互相阻塞
+ * - snapshot 依序鎖住所有分片，得到同一時間點的一致快照
+ */
+class UserRegistry {
+public:
+    static const size_t SHARD_COUNT = 64;
+
+    // 新增用戶，已存在時回傳 false
+    bool insert(const User& user) {
+        Shard& shard = shardFor(user.username);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.users.emplace(user.username, user).second;
+    }
+
+    // 移除用戶，不存在時回傳 false
+    bool erase(std::string_view username) {
+        Shard& shard = shardFor(username);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.users.erase(std::string(username)) > 0;
+    }
+
+    // 以共享鎖讀取，找不到時回傳 false
+    template <typename F>
+    bool read(std::string_view username, F&& fn) const {
+        const Shard& shard = shardFor(username);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.users.find(std::string(username));
+        if (it == shard.users.end()) return false;
+        fn(it->second);
+        return true;
+    }
+
+    // 以獨佔鎖修改，找不到時回傳 false
+    template <typename F>
+    bool update(std::string_view username, F&& fn) {
+        Shard& shard = shardFor(username);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.users.find(std::string(username));
+        if (it == shard.users.end()) return false;
+        fn(it->second);
+        return true;
+    }
+
+    // 一致快照：同時持有所有分片的共享鎖，複製符合條件的用戶
+    template <typename Pred>
+    std::vector<User> snapshot(Pred&& pred) const {
+        std::vector<std::shared_lock<std::shared_mutex>> locks;
+        locks.reserve(SHARD_COUNT);
+        for (const Shard& shard : shards) {
+            locks.emplace_back(shard.mutex);
+        }
+
+        std::vector<User> result;
+        for (const Shard& shard : shards) {
+            for (const auto& pair : shard.users) {
+                if (pred(pair.second)) {
+                    result.push_back(pair.second);
+                }
+            }
+        }
+        return result;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const Shard& shard : shards) {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            total += shard.users.size();
+        }
+        return total;
+    }
+
+private:
+    // 每個分片獨佔 cache line，避免不同分片的鎖互相干擾
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, User> users;
+    };
+
+    Shard shards[SHARD_COUNT];
+
+    Shard& shardFor(std::string_view username) {
+        return shards[std::hash<std::string_view>()(username) % SHARD_COUNT];
+    }
+
+    const Shard& shardFor(std::string_view username) const {
+        return shards[std::hash<std::string_view>()(username) % SHARD_COUNT];
+    }
+};
+
+/**
+ * 上線索引 (Online Endpoint Index)
+ *
+ * 只記錄目前上線的用戶與其 P2P 端點 (IP:port)，登入、登出時維護。
+ * 登入檢查與 LIST 的成本只跟上線人數有關，與註冊帳號總數無關。
+ */
+class OnlineIndex {
+public:
+    struct Endpoint {
+        std::string ip;
+        int port;
+    };
+
+    enum class ClaimResult {
+        Ok,
+        AlreadyOnline,
+        EndpointInUse
+    };
+
+    // 標記上線並佔用端點 (兩項檢查與寫入在同一把鎖內完成)
+    ClaimResult claim(const std::string& username, const std::string& ip, int port) {
+        std::string key = endpointKey(ip, port);
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (online.count(username)) return ClaimResult::AlreadyOnline;
+        if (endpoints.count(key)) return ClaimResult::EndpointInUse;
+        online.emplace(username, Endpoint{ip, port});
+        endpoints.emplace(std::move(key), username);
+        return ClaimResult::Ok;
+    }
+
+    // 下線並釋放端點，原本不在線上時回傳 false
+    bool release(const std::string& username) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = online.find(username);
+        if (it == online.end()) return false;
+        endpoints.erase(endpointKey(it->second.ip, it->second.port));
+        online.erase(it);
+        return true;
+    }
+
+    bool lookup(std::string_view username, Endpoint& endpoint) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = online.find(username);
+        if (it == online.end()) return false;
+        endpoint = it->second;
+        return true;
+    }
+
+    // 依名稱順序走訪所有上線用戶 (持有共享鎖)
+    template <typename F>
+    void forEach(F&& fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        for (const auto& pair : online) {
+            fn(pair.first, pair.second);
+        }
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return online.size();
+    }
+
+private:
+    mutable std::shared_mutex mutex;
+    std::map<std::string, Endpoint, std::less<>> online;        // username -> endpoint
+    std::unordered_map<std::string, std::string> endpoints;     // "ip:port" -> username
+
+    static std::string endpointKey(const std::string& ip, int port) {
+        return ip + ":" + std::to_string(port);
+    }
+};
+
+#endif // USER_REGISTRY_H
@@ -0,0 +1,517 @@
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "Logger.h"
+#include "CommandParser.h"
+#include "UserRegistry.h"
+
+/**
+ * Phase 2: 持久化帳號 (Write-Ahead Log + Group Commit + Snapshot)
+ *
+ * 目錄內容:
+ *   users.snapshot      某個 LSN 時的完整帳號快照 (先寫 .tmp 再 rename，永遠是完整的)
+ *   wal.<起始 LSN>      快照之後的異動紀錄，只會附加
+ *
+ * - 每筆異動分配遞增的 LSN，放進待寫緩衝後立即返回，不在呼叫端等待磁碟
+ * - 背景 committer 一次把緩衝內所有紀錄寫出並 fdatasync 一次 (group commit)，
+ *   fsync 進行中到達的請求會在下一批一起落盤，不會每筆註冊各付一次 fsync
+ * - 一批落盤 (或寫入失敗) 後，committer 依序呼叫該批每筆紀錄的完成回呼
+ * - 累積 snapshotEvery 筆後寫一次快照，並刪除快照已涵蓋的 WAL 檔；
+ *   快照來自 committer 維護的已落盤帳號表，不含尚未落盤或寫入失敗的異動
+ * - 啟動時載入快照，只重播 LSN 大於快照的 WAL 紀錄；只有紀錄全被快照涵蓋的 WAL 會刪除，
+ *   含殘缺或損毀紀錄的 WAL 重播可讀的部分後改名為 wal.<LSN>.corrupt 保留
+ *
+ * WAL 紀錄格式 (主機位元組順序):
+ *   [u32 內容長度][u32 checksum][u64 lsn][u8 type][u16 username 長度][u16 password 長度][username][password]
+ */
+class UserStore {
+public:
+    enum RecordType : uint8_t {
+        RecordRegister = 1,
+        RecordSetPassword = 2   // 密碼變更 (例如舊明文密碼升級為雜湊)
+    };
+
+    UserStore(std::string dir, size_t snapshotEvery)
+        : root(std::move(dir)), snapshotEvery(std::max<size_t>(snapshotEvery, 1)),
+          walFd(-1), nextLsn(1),
+          lastSnapshotLsn(0), recordsSinceSnapshot(0), stopping(false) {
+        if (root.empty()) return;
+        if (::mkdir(root.c_str(), 0700) != 0 && errno != EEXIST) {
+            LOG_ERROR("⚠️ UserStore: cannot create " << root << ": " << strerror(errno)
+                      << ", accounts are memory-only");
+            root.clear();
+        }
+    }
+
+    ~UserStore() {
+        close();
+        if (walFd >= 0) {
+            ::close(walFd);
+        }
+    }
+
+    UserStore(const UserStore&) = delete;
+    UserStore& operator=(const UserStore&) = delete;
+
+    bool enabled() const { return !root.empty(); }
+    const std::string& directory() const { return root; }
+
+    // 載入快照並重播 WAL，之後啟動 committer；回傳載入的帳號數
+    size_t load(UserRegistry& users) {
+        if (!enabled()) return 0;
+
+        uint64_t maxLsn = loadSnapshot(users);
+        size_t replayed = 0;
+        for (uint64_t firstLsn : listWalFiles()) {
+            std::string path = walPath(firstLsn);
+            bool intact = false;
+            size_t records = replayWal(path, users, maxLsn, intact);
+            if (!intact) {
+                // 不確定損毀處之後有沒有快照未涵蓋的紀錄，改名保留 (不再符合 wal.<LSN>，不會被重播或刪除)
+                std::string corruptPath = path + ".corrupt";
+                if (::rename(path.c_str(), corruptPath.c_str()) == 0) {
+                    LOG_ERROR("⚠️ UserStore: " << path << " is damaged, replayed " << records
+                              << " records and kept it as " << corruptPath);
+                } else {
+                    LOG_ERROR("⚠️ UserStore: cannot rename damaged " << path << ": " << strerror(errno));
+                }
+            } else if (records == 0) {
+                ::unlink(path.c_str());  // 紀錄全部不大於快照 LSN
+            }
+            replayed += records;
+        }
+        nextLsn = maxLsn + 1;
+
+        if (!openWal(nextLsn)) {
+            LOG_ERROR("⚠️ UserStore: WAL unavailable, accounts are memory-only");
+            root.clear();
+            return users.size();
+        }
+
+        recordsSinceSnapshot = replayed;
+        if (recordsSinceSnapshot >= snapshotEvery) {
+            writeSnapshot(maxLsn);
+        }
+
+        committer = std::thread([this]() { commitLoop(); });
+        return users.size();
+    }
+
+    // 寫出緩衝內剩餘的紀錄並停止 committer，之後的紀錄直接以失敗完成
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        pendingReady.notify_one();
+        if (committer.joinable()) {
+            committer.join();
+        }
+    }
+
+    // 落盤結果回呼，ok 為 false 表示寫入失敗；由 committer 執行緒呼叫 (未啟用時在呼叫端直接呼叫)
+    using Completion = std::function<void(bool ok)>;
+
+    // 記錄一筆註冊，不等待落盤；group commit 完成後呼叫 done
+    void logRegister(const std::string& username, const std::string& password, Completion done) {
+        logRecord(RecordRegister, username, password, std::move(done));
+    }
+
+    void logSetPassword(const std::string& username, const std::string& password, Completion done) {
+        logRecord(RecordSetPassword, username, password, std::move(done));
+    }
+
+private:
+    void logRecord(RecordType type, const std::string& username, const std::string& password, Completion done) {
+        if (!enabled()) {
+            done(true);
+            return;
+        }
+        if (username.size() > UINT16_MAX || password.size() > UINT16_MAX) {
+            done(false);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!stopping) {
+                appendRecord(pending, nextLsn++, type, username, password);
+                pendingCompletions.push_back(std::move(done));
+                pendingReady.notify_one();
+                return;
+            }
+        }
+        done(false);  // 已關閉
+    }
+
+    static const size_t WAL_HEADER_SIZE = 21;
+    static const size_t SNAPSHOT_HEADER_SIZE = 24;
+    static constexpr const char* SNAPSHOT_MAGIC = "CHATUSR1";
+
+    std::string root;
+    size_t snapshotEvery;
+    // 已落盤的帳號 (username -> password)，只由 committer 使用 (啟動時由 load)
+    // registry 在落盤前就已插入新帳號，快照不能直接複製 registry
+    std::unordered_map<std::string, std::string> committedUsers;
+
+    // mutex 保護以下欄位；walFd 與快照只由 committer 使用 (啟動時由 load)
+    std::mutex mutex;
+    std::condition_variable pendingReady;
+    std::string pending;                        // 尚未寫出的紀錄
+    std::vector<Completion> pendingCompletions;  // 與 pending 內的紀錄一一對應
+    int walFd;
+    uint64_t nextLsn;
+    uint64_t lastSnapshotLsn;
+    size_t recordsSinceSnapshot;
+    bool stopping;
+    std::thread committer;
+    bool walBroken = false;       // walFd 可能以殘缺紀錄結尾，不能再附加 (只由 committer 使用)
+
+    // FNV-1a，用來辨識殘缺或損毀的紀錄
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    static void appendRecord(std::string& out, uint64_t lsn, uint8_t type,
+                             const std::string& username, const std::string& password) {
+        uint16_t userLength = (uint16_t)username.size();
+        uint16_t passLength = (uint16_t)password.size();
+        uint32_t length = (uint32_t)(WAL_HEADER_SIZE - 8 + username.size() + password.size());
+
+        size_t start = out.size();
+        out.resize(start + 8 + length);
+        char* p = &out[start];
+        memcpy(p + 8, &lsn, sizeof(lsn));
+        p[16] = (char)type;
+        memcpy(p + 17, &userLength, sizeof(userLength));
+        memcpy(p + 19, &passLength, sizeof(passLength));
+        memcpy(p + WAL_HEADER_SIZE, username.data(), username.size());
+        memcpy(p + WAL_HEADER_SIZE + username.size(), password.data(), password.size());
+        uint32_t sum = checksum(p + 8, length);
+        memcpy(p, &length, sizeof(length));
+        memcpy(p + 4, &sum, sizeof(sum));
+    }
+
+    std::string walPath(uint64_t firstLsn) const {
+        return root + "/wal." + std::to_string(firstLsn);
+    }
+
+    std::string snapshotPath() const { return root + "/users.snapshot"; }
+
+    std::vector<uint64_t> listWalFiles() const {
+        std::vector<uint64_t> result;
+        DIR* dir = opendir(root.c_str());
+        if (dir == nullptr) return result;
+        while (dirent* entry = readdir(dir)) {
+            std::string_view name(entry->d_name);
+            uint64_t firstLsn = 0;
+            if (name.size() > 4 && name.substr(0, 4) == "wal." &&
+                CommandParser::parseInt(name.substr(4), firstLsn)) {
+                result.push_back(firstLsn);
+            }
+        }
+        closedir(dir);
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    static bool readFile(const std::string& path, std::string& content) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        content.clear();
+        char buffer[65536];
+        ssize_t n;
+        while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            content.append(buffer, (size_t)n);
+        }
+        ::close(fd);
+        return n == 0;
+    }
+
+    static bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    static bool syncFile(int fd) {
+#if defined(__linux__)
+        return fdatasync(fd) == 0;
+#elif defined(__APPLE__)
+        // macOS 的 fsync 不會清掉磁碟快取
+        return fcntl(fd, F_FULLFSYNC) == 0 || fsync(fd) == 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
+
+    // 新建檔案或 rename 後要 fsync 目錄，目錄項目才算落盤
+    void syncDirectory() const {
+        int fd = ::open(root.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    // 從 firstLsn 開始寫新的 WAL 檔
+    bool openWal(uint64_t firstLsn) {
+        int fd = ::open(walPath(firstLsn).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (fd < 0) {
+            LOG_ERROR("⚠️ UserStore: cannot open " << walPath(firstLsn) << ": " << strerror(errno));
+            return false;
+        }
+        syncDirectory();
+        if (walFd >= 0) ::close(walFd);
+        walFd = fd;
+        return true;
+    }
+
+    // 回傳快照的 LSN，沒有快照時回傳 0
+    uint64_t loadSnapshot(UserRegistry& users) {
+        std::string content;
+        if (!readFile(snapshotPath(), content)) return 0;
+        if (content.size() < SNAPSHOT_HEADER_SIZE || content.compare(0, 8, SNAPSHOT_MAGIC) != 0) {
+            LOG_ERROR("⚠️ UserStore: " << snapshotPath() << " is not a user snapshot, ignoring it");
+            return 0;
+        }
+
+        uint64_t lsn, count;
+        memcpy(&lsn, content.data() + 8, sizeof(lsn));
+        memcpy(&count, content.data() + 16, sizeof(count));
+
+        size_t offset = SNAPSHOT_HEADER_SIZE;
+        uint64_t loaded = 0;
+        for (; loaded < count; ++loaded) {
+            std::string username, password;
+            if (!parseSnapshotRecord(content, offset, username, password)) break;
+            users.insert(User(username, password));
+            committedUsers.emplace(std::move(username), std::move(password));
+        }
+        if (loaded != count) {
+            LOG_ERROR("⚠️ UserStore: snapshot is damaged, loaded " << loaded << " of " << count << " users");
+        }
+        lastSnapshotLsn = lsn;
+        return lsn;
+    }
+
+    // 快照紀錄: [u32 checksum][u16 username 長度][u16 password 長度][username][password]
+    static bool parseSnapshotRecord(const std::string& content, size_t& offset,
+                                    std::string& username, std::string& password) {
+        if (offset + 8 > content.size()) return false;
+        const char* p = content.data() + offset;
+        uint32_t sum;
+        uint16_t userLength, passLength;
+        memcpy(&sum, p, sizeof(sum));
+        memcpy(&userLength, p + 4, sizeof(userLength));
+        memcpy(&passLength, p + 6, sizeof(passLength));
+        size_t length = 4 + (size_t)userLength + passLength;
+        if (offset + 4 + length > content.size() || checksum(p + 4, length) != sum) return false;
+        username.assign(p + 8, userLength);
+        password.assign(p + 8 + userLength, passLength);
+        offset += 4 + length;
+        return true;
+    }
+
+    static void appendSnapshotRecord(std::string& out, const std::string& username, const std::string& password) {
+        uint16_t userLength = (uint16_t)username.size();
+        uint16_t passLength = (uint16_t)password.size();
+        size_t start = out.size();
+        out.resize(start + 8 + userLength + passLength);
+        char* p = &out[start];
+        memcpy(p + 4, &userLength, sizeof(userLength));
+        memcpy(p + 6, &passLength, sizeof(passLength));
+        memcpy(p + 8, username.data(), userLength);
+        memcpy(p + 8 + userLength, password.data(), passLength);
+        uint32_t sum = checksum(p + 4, 4 + (size_t)userLength + passLength);
+        memcpy(p, &sum, sizeof(sum));
+    }
+
+    struct WalRecord {
+        uint64_t lsn;
+        uint8_t type;
+        std::string_view username;
+        std::string_view password;
+    };
+
+    // 解析 offset 處的一筆完整紀錄並移到下一筆；殘缺或損毀時回傳 false (offset 不變)
+    static bool parseWalRecord(const std::string& content, size_t& offset, WalRecord& record) {
+        if (offset + WAL_HEADER_SIZE > content.size()) return false;
+        const char* p = content.data() + offset;
+        uint32_t length, sum;
+        uint16_t userLength, passLength;
+        memcpy(&length, p, sizeof(length));
+        memcpy(&sum, p + 4, sizeof(sum));
+        if (length < WAL_HEADER_SIZE - 8 || offset + 8 + length > content.size() ||
+            checksum(p + 8, length) != sum) {
+            return false;
+        }
+        memcpy(&record.lsn, p + 8, sizeof(record.lsn));
+        memcpy(&userLength, p + 17, sizeof(userLength));
+        memcpy(&passLength, p + 19, sizeof(passLength));
+        if (WAL_HEADER_SIZE - 8 + (size_t)userLength + passLength != length) return false;
+        record.type = (uint8_t)p[16];
+        record.username = std::string_view(p + WAL_HEADER_SIZE, userLength);
+        record.password = std::string_view(p + WAL_HEADER_SIZE + userLength, passLength);
+        offset += 8 + length;
+        return true;
+    }
+
+    // 已落盤的紀錄套用到 committedUsers (規則與 registry 相同：重複註冊忽略、不存在的帳號不改密碼)
+    void applyCommitted(const WalRecord& record) {
+        if (record.type == RecordRegister) {
+            committedUsers.emplace(std::string(record.username), std::string(record.password));
+        } else if (record.type == RecordSetPassword) {
+            auto it = committedUsers.find(std::string(record.username));
+            if (it != committedUsers.end()) it->second.assign(record.password);
+        }
+    }
+
+    // 重播一個 WAL 檔中 LSN 大於快照的紀錄，回傳重播的紀錄數
+    // intact 表示整個檔案都讀得到且每筆紀錄都完整
+    size_t replayWal(const std::string& path, UserRegistry& users, uint64_t& maxLsn, bool& intact) {
+        std::string content;
+        intact = readFile(path, content);
+        if (!intact) return 0;
+
+        size_t offset = 0, records = 0;
+        WalRecord record;
+        while (parseWalRecord(content, offset, record)) {
+            if (record.lsn > lastSnapshotLsn) {
+                std::string username(record.username), password(record.password);
+                if (record.type == RecordRegister) {
+                    users.insert(User(username, password));
+                } else if (record.type == RecordSetPassword) {
+                    users.update(username, [&](User& user) { user.password = password; });
+                } else {
+                    LOG_WARN("⚠️ UserStore: unknown record type " << (int)record.type << " in " << path);
+                }
+                applyCommitted(record);
+                ++records;
+            }
+            maxLsn = std::max(maxLsn, record.lsn);
+        }
+        if (offset < content.size()) {
+            LOG_WARN("⚠️ UserStore: ignored " << (content.size() - offset) << " unreadable bytes in " << path);
+            intact = false;
+        }
+        return records;
+    }
+
+    // 寫出 lsn 時的快照，成功後刪除已被涵蓋的 WAL 檔 (只由 committer 或 load 呼叫)
+    void writeSnapshot(uint64_t lsn) {
+        // 先換新的 WAL 檔，舊檔內的紀錄都不大於 lsn
+        std::vector<uint64_t> covered = listWalFiles();
+        if (!openWal(lsn + 1)) return;
+        covered.erase(std::remove(covered.begin(), covered.end(), lsn + 1), covered.end());
+
+        // committedUsers 剛好是 lsn 為止已落盤的狀態 (呼叫端在套用完這批之後才寫快照)
+        std::string content(SNAPSHOT_MAGIC, 8);
+        uint64_t count = committedUsers.size();
+        content.append((const char*)&lsn, sizeof(lsn));
+        content.append((const char*)&count, sizeof(count));
+        for (const auto& entry : committedUsers) {
+            appendSnapshotRecord(content, entry.first, entry.second);
+        }
+
+        std::string tmpPath = snapshotPath() + ".tmp";
+        int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        bool ok = fd >= 0 && writeAll(fd, content.data(), content.size()) && syncFile(fd);
+        if (fd >= 0) ::close(fd);
+        if (!ok || ::rename(tmpPath.c_str(), snapshotPath().c_str()) != 0) {
+            LOG_ERROR("⚠️ UserStore: snapshot failed: " << strerror(errno));
+            ::unlink(tmpPath.c_str());
+            return;
+        }
+        syncDirectory();
+
+        for (uint64_t firstLsn : covered) {
+            ::unlink(walPath(firstLsn).c_str());
+        }
+        lastSnapshotLsn = lsn;
+        recordsSinceSnapshot = 0;
+        LOG_INFO("💾 UserStore: snapshot of " << count << " users at LSN " << lsn);
+    }
+
+    void commitLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            pendingReady.wait(lock, [&]() { return stopping || !pending.empty(); });
+            if (pending.empty()) break;  // stopping 且已全部寫出
+
+            std::string batch;
+            batch.swap(pending);
+            std::vector<Completion> completions;
+            completions.swap(pendingCompletions);
+            size_t records = completions.size();
+            uint64_t batchEnd = nextLsn - 1;
+            uint64_t batchStart = batchEnd - records + 1;
+            lock.unlock();
+
+            // 上次寫入失敗後沒能換到新檔：先重試，仍然失敗就整批失敗，不接在殘缺紀錄後面
+            if (walBroken && openWal(batchStart)) {
+                walBroken = false;
+                LOG_INFO("UserStore: WAL reopened at LSN " << batchStart);
+            }
+
+            // 一批只寫一次、fsync 一次
+            bool ok = !walBroken && writeAll(walFd, batch.data(), batch.size()) && syncFile(walFd);
+            if (ok) {
+                size_t offset = 0;
+                WalRecord record;
+                while (parseWalRecord(batch, offset, record)) {
+                    applyCommitted(record);
+                }
+                LOG_DEBUG("UserStore: group commit of " << records << " records");
+            } else if (!walBroken) {
+                // 檔尾可能留下半筆紀錄，換新檔避免之後的紀錄接在殘缺紀錄後面
+                LOG_ERROR("⚠️ UserStore: WAL write failed: " << strerror(errno));
+                if (!openWal(batchEnd + 1)) {
+                    walBroken = true;
+                    LOG_ERROR("⚠️ UserStore: no usable WAL, failing commits until a new WAL can be opened");
+                }
+            }
+
+            // 先通知這批的請求再寫快照 (不持有 mutex，回呼可以再送出新的紀錄)
+            for (Completion& done : completions) {
+                done(ok);
+            }
+
+            lock.lock();
+            if (ok && (recordsSinceSnapshot += records) >= snapshotEvery) {
+                lock.unlock();
+                writeSnapshot(batchEnd);
+                lock.lock();
+            }
+        }
+    }
+};
+
+#endif // USER_STORE_H
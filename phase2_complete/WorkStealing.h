@@ -0,0 +1,602 @@
+#ifndef WORK_STEALING_H
+#define WORK_STEALING_H
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+#include <algorithm>
+#include "Logger.h"
+#include "Task.h"
+#include "PoolStats.h"
+#include "CpuTopology.h"
+
+/**
+ * Phase 2: 工作竊取排程器 (Work-Stealing Scheduler)
+ *
+ * - 每個 worker 有自己的 Chase-Lev deque：只有擁有者從底端 push/pop，不需要鎖
+ * - 沒有工作時隨機挑其他 worker 從頂端偷 (CAS)，負載自動平衡
+ * - 外部執行緒 (事件迴圈) 送來的任務放進無鎖的 injection queue，
+ *   worker 一次取一小批到自己的 deque
+ * - worker 內送出的任務 (例如 drainConnection 重新排程) 直接放進自己的 deque
+ * - 閒置的 worker 睡在 condition variable 上，有新任務時才喚醒
+ * - 彈性模式：預先配置 maxThreads 個 slot (deque)，只啟動 minThreads 個 worker；
+ *   從 injection queue 取到等待過久的任務且沒有人睡著時啟動新 worker，
+ *   閒置超過 keepAlive 的 worker 退出並留下空的 deque 給之後重用
+ * - 優先等級：High 與 Bulk 任務不進 deque，各自放在獨立的 injection queue；
+ *   worker 依 High > Normal (deque/injection/竊取) > Bulk 的順序找工作，
+ *   每隔幾次輪到較低的等級先取避免餓死；Bulk 同時執行數上限為 worker 數的一半
+ */
+
+/**
+ * Chase-Lev work-stealing deque
+ * (Lê, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP 2013)
+ */
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256)
+        : top(0), bottom(0), array(new Array(capacity)) {}
+
+    ~WorkStealingDeque() {
+        delete array.load(std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // 擁有者：放到底端，滿了就加倍
+    void push(TaskNode* task) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Array* a = array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            Array* bigger = a->grow(b, t);
+            // 小偷可能還在讀舊陣列，解構時才釋放
+            retired.emplace_back(a);
+            array.store(bigger, std::memory_order_release);
+            a = bigger;
+        }
+        a->put(b, task);
+        // release store (而非論文中的 release fence)：效果相同，ThreadSanitizer 也看得懂
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    // 擁有者：從底端取 (LIFO)
+    TaskNode* pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        TaskNode* task = a->get(b);
+        if (t == b) {
+            // 只剩最後一個，與小偷競爭
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                task = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    // 其他 worker：從頂端偷 (FIFO)，空的或競爭失敗回傳 nullptr
+    TaskNode* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+
+        Array* a = array.load(std::memory_order_acquire);
+        TaskNode* task = a->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return task;
+    }
+
+    int64_t size() const {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+private:
+    struct Array {
+        int64_t capacity;  // 2 的次方
+        std::unique_ptr<std::atomic<TaskNode*>[]> slots;
+
+        explicit Array(int64_t c) : capacity(c), slots(new std::atomic<TaskNode*>[c]) {}
+
+        TaskNode* get(int64_t i) const {
+            return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, TaskNode* task) {
+            slots[i & (capacity - 1)].store(task, std::memory_order_relaxed);
+        }
+
+        Array* grow(int64_t b, int64_t t) const {
+            Array* bigger = new Array(capacity * 2);
+            for (int64_t i = t; i < b; ++i) {
+                bigger->put(i, get(i));
+            }
+            return bigger;
+        }
+    };
+
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    std::atomic<Array*> array;
+    std::vector<std::unique_ptr<Array>> retired;  // 只由擁有者存取
+};
+
+/**
+ * 外部任務的 injection queue
+ *
+ * Vyukov 的侵入式 MPSC 佇列：生產者只做一次 atomic exchange，完全無鎖；
+ * 消費端同一時間只允許一個 worker (tryAcquire)，其他 worker 直接去偷別人的 deque。
+ */
+class InjectionQueue {
+public:
+    InjectionQueue() : head(&stub), tail(&stub), consuming(false) {}
+
+    // 任何執行緒
+    void push(TaskNode* task) {
+        pushChain(task, task);
+    }
+
+    // 已用 next 串好的 first..last 一次放入 (同樣只有一次 exchange)
+    void pushChain(TaskNode* first, TaskNode* last) {
+        last->next.store(nullptr, std::memory_order_relaxed);
+        TaskNode* prev = head.exchange(last, std::memory_order_acq_rel);
+        prev->next.store(first, std::memory_order_release);
+    }
+
+    bool tryAcquire() {
+        bool expected = false;
+        return !consuming.load(std::memory_order_relaxed) &&
+               consuming.compare_exchange_strong(expected, true, std::memory_order_acquire);
+    }
+
+    void release() {
+        consuming.store(false, std::memory_order_release);
+    }
+
+    // 只能在 tryAcquire 成功後呼叫；生產者正在串接時可能暫時回傳 nullptr
+    TaskNode* pop() {
+        TaskNode* t = tail;
+        TaskNode* next = t->next.load(std::memory_order_acquire);
+        if (t == &stub) {
+            if (next == nullptr) return nullptr;
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            tail = next;
+            return t;
+        }
+        if (t != head.load(std::memory_order_acquire)) return nullptr;
+
+        // t 是最後一個節點：放回 stub 後才能取出 t
+        push(&stub);
+        next = t->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            tail = next;
+            return t;
+        }
+        return nullptr;
+    }
+
+private:
+    alignas(64) std::atomic<TaskNode*> head;  // 生產者端
+    alignas(64) TaskNode* tail;               // 消費者端
+    TaskNode stub;
+    std::atomic<bool> consuming;
+};
+
+class WorkStealingScheduler {
+public:
+    static const size_t INJECT_BATCH = 16;  // 一次從 injection queue 搬到自己 deque 的上限
+    static const uint32_t NORMAL_FIRST_EVERY = 4;   // 每 4 次找工作有一次先看 Normal 再看 High
+    static const uint32_t BULK_FIRST_EVERY = 21;    // 每 21 次有一次先看 Bulk (約與共享佇列的權重相同)
+
+    explicit WorkStealingScheduler(size_t threads)
+        : WorkStealingScheduler(threads, threads, std::chrono::microseconds(0), std::chrono::milliseconds(0)) {}
+
+    WorkStealingScheduler(size_t minThreads, size_t maxThreads,
+                          std::chrono::microseconds spawnWait, std::chrono::milliseconds keepAlive,
+                          const CpuPlacement& placement = CpuPlacement())
+        : minThreads(std::max<size_t>(minThreads, 1)),
+          elastic(std::max<size_t>(minThreads, 1) < maxThreads),
+          spawnWait(spawnWait), keepAlive(keepAlive), placement(placement),
+          stopping(false), pendingTasks(0), pendingHigh(0), pendingBulk(0), bulkRunning(0), peakPending(0), sleepers(0), activeWorkers(0) {
+        maxThreads = std::max(maxThreads, this->minThreads);
+        for (size_t i = 0; i < maxThreads; ++i) {
+            workers.emplace_back(new Worker(0x9E3779B97F4A7C15ull * (i + 1)));
+        }
+        for (size_t slot = maxThreads; slot > 0; --slot) {
+            freeSlots.push_back(slot - 1);
+        }
+        std::lock_guard<std::mutex> lock(resize_mutex);
+        lastGrow = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < this->minThreads; ++i) {
+            spawnWorker();
+        }
+    }
+
+    // 等待已送出的任務全部執行完再結束 (與 ThreadPool 的共享佇列相同)
+    ~WorkStealingScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(park_mutex);
+            stopping.store(true, std::memory_order_seq_cst);
+        }
+        park.notify_all();
+        {
+            // 等進行中的擴充結束，之後不會再有新 worker
+            std::lock_guard<std::mutex> lock(resize_mutex);
+        }
+        for (auto& worker : workers) {
+            if (worker->thread.joinable()) worker->thread.join();
+        }
+    }
+
+    WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+    WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+    // 失敗 (已停止) 時丟出例外，節點由呼叫端歸還
+    void submit(TaskNode* task) {
+        submitChain(task, task, 1);
+    }
+
+    // 一次送出 count 個以 next 串好、優先等級相同的節點 (first..last)
+    // 計數器各只更新一次，injection queue 只做一次 exchange；worker 內送出的 Normal 直接放進自己的 deque
+    void submitChain(TaskNode* first, TaskNode* last, size_t count) {
+        if (stopping.load(std::memory_order_acquire)) {
+            throw std::runtime_error("enqueue on stopped ThreadPool");
+        }
+        TaskPriority priority = first->priority;
+        // 先計數再放入，worker 取出後的遞減不會跑到前面
+        // (pendingTasks 先加：短暫看起來「有可執行的任務」只會多轉一圈，不會漏掉)
+        size_t depth = pendingTasks.fetch_add(count, std::memory_order_seq_cst) + count;
+        size_t peak = peakPending.load(std::memory_order_relaxed);
+        while (depth > peak && !peakPending.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {
+        }
+        if (priority == TaskPriority::High) {
+            pendingHigh.fetch_add(count, std::memory_order_seq_cst);
+        } else if (priority == TaskPriority::Bulk) {
+            pendingBulk.fetch_add(count, std::memory_order_seq_cst);
+        }
+
+        Context& context = currentContext();
+        if (priority == TaskPriority::High) {
+            urgent.pushChain(first, last);
+        } else if (priority == TaskPriority::Bulk) {
+            bulk.pushChain(first, last);
+        } else if (context.scheduler == this) {
+            WorkStealingDeque& deque = workers[context.index]->deque;
+            for (size_t i = 0; i < count; ++i) {
+                TaskNode* next = first->next.load(std::memory_order_relaxed);
+                deque.push(first);
+                first = next;
+            }
+        } else {
+            injection.pushChain(first, last);
+        }
+
+        // 有人睡著才需要碰 park_mutex
+        if (sleepers.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(park_mutex);
+            if (count > 1) {
+                park.notify_all();
+            } else {
+                park.notify_one();
+            }
+        }
+    }
+
+    size_t workerCount() const { return activeWorkers.load(std::memory_order_relaxed); }
+
+    // 已送出但尚未開始執行的任務數
+    size_t pending() const { return pendingTasks.load(std::memory_order_relaxed); }
+
+    void collect(ThreadPoolStats& out, bool resetPeak) {
+        out.workers = workerCount();
+        out.queued = pending();
+        out.peakQueued = resetPeak ? peakPending.exchange(out.queued, std::memory_order_relaxed)
+                                   : peakPending.load(std::memory_order_relaxed);
+        int64_t now = steadyNanos(std::chrono::steady_clock::now());
+        for (size_t slot = 0; slot < workers.size(); ++slot) {
+            out.collectWorker(slot, workers[slot]->stats, now);
+        }
+    }
+
+private:
+    struct alignas(64) Worker {
+        WorkStealingDeque deque;
+        std::thread thread;
+        uint64_t rng;
+        uint32_t ticks = 0;
+        WorkerStats stats;
+
+        explicit Worker(uint64_t seed) : rng(seed) {}
+    };
+
+    struct Context {
+        WorkStealingScheduler* scheduler = nullptr;
+        size_t index = 0;
+    };
+
+    const size_t minThreads;
+    const bool elastic;
+    const std::chrono::microseconds spawnWait;
+    const std::chrono::milliseconds keepAlive;
+    const CpuPlacement placement;
+
+    std::vector<std::unique_ptr<Worker>> workers;   // maxThreads 個 slot，建構後不再變動
+    InjectionQueue injection;       // Normal (外部送入)
+    InjectionQueue urgent;          // High
+    InjectionQueue bulk;            // Bulk
+    std::atomic<bool> stopping;
+    std::atomic<size_t> pendingTasks;
+    std::atomic<size_t> pendingHigh;    // pendingTasks 中的 High 任務
+    std::atomic<size_t> pendingBulk;    // pendingTasks 中的 Bulk 任務
+    std::atomic<size_t> bulkRunning;
+    std::atomic<size_t> peakPending;
+    std::atomic<int> sleepers;
+    std::atomic<size_t> activeWorkers;
+    std::mutex park_mutex;
+    std::condition_variable park;
+
+    // 擴充/縮減 (resize_mutex 保護)
+    std::mutex resize_mutex;
+    std::vector<size_t> freeSlots;
+    std::chrono::steady_clock::time_point lastGrow;
+
+    static Context& currentContext() {
+        thread_local Context context;
+        return context;
+    }
+
+    static uint64_t nextRandom(uint64_t& state) {
+        // xorshift64
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    // 需持有 resize_mutex；slot 上已退出的舊執行緒先 join (它退出後不再碰 resize_mutex)
+    void spawnWorker() {
+        size_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        Worker& worker = *workers[slot];
+        if (worker.thread.joinable()) {
+            worker.thread.join();
+        }
+        activeWorkers.fetch_add(1, std::memory_order_relaxed);
+        worker.thread = std::thread([this, slot]() { workerLoop(slot); });
+    }
+
+    // worker 取到等待過久的任務時呼叫；別人正在調整就跳過
+    void maybeGrow(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point queuedAt) {
+        std::unique_lock<std::mutex> lock(resize_mutex, std::try_to_lock);
+        if (!lock.owns_lock() || stopping.load(std::memory_order_acquire) || freeSlots.empty()) return;
+        if (now - lastGrow < spawnWait) return;
+        lastGrow = now;
+        spawnWorker();
+        LOG_INFO("ThreadPool grew to " << activeWorkers.load(std::memory_order_relaxed)
+                 << " workers (oldest task waited "
+                 << std::chrono::duration_cast<std::chrono::microseconds>(now - queuedAt).count()
+                 << "us, " << pendingTasks.load(std::memory_order_relaxed) << " queued)");
+    }
+
+    // 閒置超過 keepAlive 的 worker 退出 (不低於 minThreads，最近有擴充過也不退)
+    bool tryRetire(size_t index, std::chrono::steady_clock::time_point now) {
+        std::lock_guard<std::mutex> lock(resize_mutex);
+        if (stopping.load(std::memory_order_acquire) ||
+            activeWorkers.load(std::memory_order_relaxed) <= minThreads || now - lastGrow < keepAlive) {
+            return false;
+        }
+        activeWorkers.fetch_sub(1, std::memory_order_relaxed);
+        freeSlots.push_back(index);
+        LOG_INFO("ThreadPool shrank to " << activeWorkers.load(std::memory_order_relaxed)
+                 << " workers (idle " << keepAlive.count() << "ms)");
+        return true;
+    }
+
+    // 從 injection queue 取一批：第一個直接執行，其餘放進自己的 deque
+    TaskNode* takeInjected(Worker& self) {
+        if (!injection.tryAcquire()) return nullptr;
+        TaskNode* first = injection.pop();
+        if (first != nullptr) {
+            size_t want = pendingTasks.load(std::memory_order_relaxed) /
+                          std::max<size_t>(activeWorkers.load(std::memory_order_relaxed), 1) + 1;
+            TaskNode* batch[INJECT_BATCH];
+            size_t count = 0;
+            while (count < INJECT_BATCH - 1 && count < want) {
+                TaskNode* task = injection.pop();
+                if (task == nullptr) break;
+                batch[count++] = task;
+            }
+            // 倒著放，讓擁有者 pop 時仍依到達順序執行
+            while (count > 0) {
+                self.deque.push(batch[--count]);
+            }
+        }
+        injection.release();
+        checkGrowth(first);
+        return first;
+    }
+
+    // 外部送來的任務等太久且沒有閒置 worker：再加一個
+    void checkGrowth(TaskNode* task) {
+        if (task != nullptr && elastic && sleepers.load(std::memory_order_relaxed) == 0) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - task->queuedAt >= spawnWait) {
+                maybeGrow(now, task->queuedAt);
+            }
+        }
+    }
+
+    // 從 High/Bulk 的 injection queue 取一個 (不搬進 deque，deque 只放 Normal)
+    TaskNode* takeOne(InjectionQueue& queue) {
+        if (!queue.tryAcquire()) return nullptr;
+        TaskNode* task = queue.pop();
+        queue.release();
+        return task;
+    }
+
+    TaskNode* takeUrgent() {
+        if (pendingHigh.load(std::memory_order_relaxed) == 0) return nullptr;
+        TaskNode* task = takeOne(urgent);
+        if (task != nullptr) {
+            pendingHigh.fetch_sub(1, std::memory_order_seq_cst);
+            checkGrowth(task);
+        }
+        return task;
+    }
+
+    size_t bulkLimit() const {
+        return std::max<size_t>(activeWorkers.load(std::memory_order_relaxed) / 2, 1);
+    }
+
+    // Bulk 未達同時執行上限才取 (先佔名額，取不到再還回去)
+    TaskNode* takeBulk() {
+        if (pendingBulk.load(std::memory_order_relaxed) == 0) return nullptr;
+        if (bulkRunning.fetch_add(1, std::memory_order_acq_rel) >= bulkLimit()) {
+            bulkRunning.fetch_sub(1, std::memory_order_acq_rel);
+            return nullptr;
+        }
+        TaskNode* task = takeOne(bulk);
+        if (task == nullptr) {
+            bulkRunning.fetch_sub(1, std::memory_order_acq_rel);
+            return nullptr;
+        }
+        pendingBulk.fetch_sub(1, std::memory_order_seq_cst);
+        return task;
+    }
+
+    // 只剩已達上限的 Bulk 時視為沒有可執行的任務 (去睡覺而不是空轉)
+    bool hasRunnable() const {
+        size_t pendingCount = pendingTasks.load(std::memory_order_seq_cst);
+        if (pendingCount == 0) return false;
+        return pendingCount > pendingBulk.load(std::memory_order_seq_cst) ||
+               bulkRunning.load(std::memory_order_seq_cst) < bulkLimit();
+    }
+
+    TaskNode* findTask(size_t index) {
+        Worker& self = *workers[index];
+        uint32_t tick = ++self.ticks;
+        if (tick % BULK_FIRST_EVERY == 0) {
+            if (TaskNode* task = takeBulk()) return task;
+        }
+        bool normalFirst = tick % NORMAL_FIRST_EVERY == 0;
+        if (normalFirst) {
+            if (TaskNode* task = findNormal(index)) return task;
+        }
+        if (TaskNode* task = takeUrgent()) return task;
+        if (!normalFirst) {
+            if (TaskNode* task = findNormal(index)) return task;
+        }
+        return takeBulk();
+    }
+
+    TaskNode* findNormal(size_t index) {
+        Worker& self = *workers[index];
+        if (TaskNode* task = self.deque.pop()) return task;
+        if (TaskNode* task = takeInjected(self)) return task;
+
+        size_t n = workers.size();
+        if (n > 1) {
+            size_t start = (size_t)(nextRandom(self.rng) % n);
+            for (size_t i = 0; i < n; ++i) {
+                size_t victim = (start + i) % n;
+                if (victim == index) continue;
+                if (TaskNode* task = workers[victim]->deque.steal()) return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void parkWorker() {
+        std::unique_lock<std::mutex> lock(park_mutex);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        bool finished = stopping.load(std::memory_order_seq_cst) && pendingTasks.load(std::memory_order_seq_cst) == 0;
+        if (!hasRunnable() && !finished) {
+            // 逾時只是保險 (injection queue 的生產者串接到一半時 pop 會暫時失敗)
+            park.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        sleepers.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    void workerLoop(size_t index) {
+        Context& context = currentContext();
+        context.scheduler = this;
+        context.index = index;
+        if (!placement.apply(index)) {
+            LOG_WARN("Worker " << index << " CPU placement failed, running unpinned");
+        }
+        WorkerStats& stats = workers[index]->stats;
+        stats.started(steadyNanos(std::chrono::steady_clock::now()));
+
+        bool idle = false;
+        std::chrono::steady_clock::time_point idleSince;
+        for (;;) {
+            TaskNode* task = findTask(index);
+            if (task != nullptr) {
+                idle = false;
+                pendingTasks.fetch_sub(1, std::memory_order_relaxed);
+                TaskPriority priority = task->priority;
+                bool isBulk = priority == TaskPriority::Bulk;
+                int64_t start = steadyNanos(std::chrono::steady_clock::now());
+                try {
+                    task->task();
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Worker exception: " << e.what());
+                } catch (...) {
+                    LOG_ERROR("Worker unknown exception");
+                }
+                stats.record(priority, steadyNanos(task->queuedAt), start,
+                             steadyNanos(std::chrono::steady_clock::now()));
+                TaskNodePool::release(task);
+                if (isBulk) bulkRunning.fetch_sub(1, std::memory_order_acq_rel);
+                continue;
+            }
+
+            if (!hasRunnable()) {
+                if (stopping.load(std::memory_order_seq_cst) &&
+                    pendingTasks.load(std::memory_order_seq_cst) == 0) break;
+                if (elastic) {
+                    // findTask 失敗代表自己的 deque 已空 (只有自己會放)，退出後 slot 可直接重用
+                    auto now = std::chrono::steady_clock::now();
+                    if (!idle) {
+                        idle = true;
+                        idleSince = now;
+                    } else if (now - idleSince >= keepAlive && tryRetire(index, now)) {
+                        break;
+                    }
+                }
+                parkWorker();
+            } else {
+                // 還有任務但暫時拿不到 (別人正在取)，讓出 CPU 再試
+                std::this_thread::yield();
+            }
+        }
+        // 退出的 slot 在新 worker 啟動前會先 join，這裡寫完才會被重用
+        stats.stopped(steadyNanos(std::chrono::steady_clock::now()));
+        context.scheduler = nullptr;
+    }
+};
+
+#endif // WORK_STEALING_H
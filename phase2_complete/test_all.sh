@@ -26,7 +26,7 @@ fi
 # 檢查檔案
 echo ""
 echo "📋 Checking files..."
-files=("ThreadPool.h" "Crypto.h" "P2PClient.h" "FileTransfer.h" "Server_Phase2.cpp" "Client_Phase2.cpp" "Makefile")
+files=("ThreadPool.h" "WorkStealing.h" "Task.h" "Fiber.h" "SocketIO.h" "PoolStats.h" "CpuTopology.h" "Crypto.h" "P2PClient.h" "FileTransfer.h" "EventLoop.h" "Protocol.h" "CommandParser.h" "Logger.h" "UserRegistry.h" "DirectoryCache.h" "RoomHistory.h" "HistoryStore.h" "UserStore.h" "PasswordPool.h" "Server_Phase2.cpp" "Client_Phase2.cpp" "Makefile")
 missing=0
 for f in "${files[@]}"; do
     if [ -f "$f" ]; then